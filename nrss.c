@@ -8,11 +8,19 @@ The above copyright notice and this permission notice shall be included in all c
 
 THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
-searches for orthogonal NRSS (nonadjustible reduced speed of ship) that face east in square-grid range-1 Moore neighborhood cellular automata (without B0)
+searches for NRSS (nonadjustible reduced speed of ship) in square-grid range-1 Moore neighborhood cellular automata (without B0)
+orthogonal, diagonal and oblique ships are all recorded, in separate lists, from the same soups
 see https://conwaylife.com/forums/viewtopic.php?f=11&t=6352&p=218310 for more informatio
-to compile: gcc -Wall -Werror -Ofast -o nrss nrss.c
-to use: nrss <engine-count> <max-x-seperation> <max-period> <randomize-soups-1-or-0> <state-file>
+to compile: gcc -Wall -Werror -Ofast -pthread -o nrss nrss.c
+to use: nrss [-p] [-k scalar|sse2|avx2|avx512] [-d trace-level] [-s trace-every] [-r engines] <engine-count> <max-x-seperation> <max-period> <randomize-soups-1-or-0> <state-file>
 when randomization is off it will try every possible combination of engines
+-p profiles each part of the search with hardware performance counters (or just timers if those aren't available), the profile is shown at exit or on SIGUSR1
+to check patterns: nrss classify [-t threads] [-g max-generations] [file]
+this reads RLEs (from stdin if there's no file) and prints the period, displacement, population and bounding box of each one, using every cpu unless -t is given
+-k forces the simulation kernels to be the ones for a specific instruction set, normally the best one the cpu supports is used
+-d turns on tracing at a level (see TRACE), SIGUSR2 turns it on and off while it's running, and -s only traces every nth soup
+SIGUSR1 (or a crash) shows the last few soups, any of them can be run again on its own with -r and the engines it shows
+new ships are also minimized in the background (see MINIMIZETHREADS), and the smallest version found goes in the state file after the original
 */
 
 #include <stdbool.h>
@@ -22,11 +30,17 @@ when randomization is off it will try every possible combination of engines
 #include <string.h>
 #include <signal.h>
 #include <time.h>
+#include <setjmp.h>
 
 // parameters
 
 #define RULESTR "B2-ak3ce4eikqrz5-iknq6-ek8/S1c2aek3aekn4eiknry5eiky6-ei7c8"
 
+// number of cell states, 2 is a normal INT rule and 3 or 4 is an INT generations rule (RULESTR should end in /3 or /4 then)
+// in generations rules live cells that don't survive go through the other states before they die, and only live cells count as neighbors
+// the prefilter and hashlife backend only work with 2 states
+#define STATES 2
+
 // maximum height and width, these are the base-2 logarithms
 // should not be higher than 16
 #define HEIGHT 8
@@ -41,9 +55,11 @@ typedef uint_fast64_t uint64;
 #define SIZE (HEIGHT + WIDTH)
 #define SIZEVALUE (1 << SIZE)
 
-// starting position
-#define STARTX 64
-#define STARTY ((1 << HEIGHT) / 2 - 64)
+// starting position, main moves it so the soup is in the middle of the grid
+uint16 soup_x = 64;
+uint16 soup_y = (1 << HEIGHT) / 2 - 64;
+#define STARTX soup_x
+#define STARTY soup_y
 
 // min and max y seperation between engines
 #define MINY 7
@@ -76,7 +92,7 @@ static inline void put_engine(uint8_t data[], uint32 i) {
 // maximum number of ships
 #define MAXSHIPS 4096
 
-// generations between phase checks
+// generations between phase checks (the starting one if AUTOTUNE is on)
 #define CHECKINTERVAL 64
 
 // whether to reduce the period to lowest terms
@@ -92,6 +108,80 @@ static inline void put_engine(uint8_t data[], uint32 i) {
 #define MOSTCOMMONSPEED (((uint64_t)469 << 32) | (uint64_t)64)
 #define MOSTCOMMONSPEED2 (((uint64_t)73 << 32) | (uint64_t)10)
 
+// number of generations to run each soup for in a small window before the full simulation, set to 0 to disable
+// soups that die or turn into a still life or period 2 oscillator in that time are thrown out without doing any period checks
+// off by default, its row loop is scalar rather than one of the kernels and it doesn't make searches measurably faster
+#define PREFILTERGENS 0
+
+// height and width of the prefilter window, these are base-2 logarithms
+// soups that don't fit go straight to the full simulation, which is fine since the prefilter almost never throws out soups with lots of engines
+#define PREFILTERHEIGHT 6
+#define PREFILTERWIDTH 9
+
+// whether to keep running soups that are still going after max-period generations (or that hit the edge of the grid) with a hashlife backend
+// this can find ships with periods that are way too long for the normal simulation
+#define HASHLIFE 0
+
+// the hashlife backend skips this many generations first so the soup can settle down (base-2 logarithm)
+#define HASHLIFESKIP 16
+
+// maximum period that the hashlife backend looks for
+#define HASHLIFEMAXPERIOD 65536
+
+// maximum number of quadtree nodes the hashlife backend can use at once, unused nodes get garbage collected when they run out and it gives up if that doesn't free enough
+#define HASHLIFEMAXNODES (1 << 20)
+
+// generations per step when the hashlife backend looks for the period (base-2 logarithm)
+// bigger steps let it skip more, the exact period is worked out afterwards
+#define HASHLIFESTEP 6
+
+// number of threads that minimize new ships in the background, set to 0 to disable
+// they try removing engines and then single cells while the soup still makes a ship with the same speed, and the result goes in the state file after the original
+// they run at the lowest priority, so they only use time the search isn't using
+#define MINIMIZETHREADS 1
+
+// whether to learn which engine placements find ships in random mode and pick them more often
+// every y gap, x offset and engine count gets weighted by how well the soups it was used in did, and the weights are saved in the state file
+// with this on engine-count is the maximum number of engines, and soups get from 2 to engine-count engines (a single engine is always one of the same few patterns)
+#define ADAPTIVE 0
+
+// chance of ignoring the learned weights and picking uniformly, so nothing gets starved
+#define ADAPTIVEEXPLORE 0.2
+
+// reward for a soup that finds a new speed, soups that find a ship that's already known or last until max-period (or the edge of the grid) get 1
+#define ADAPTIVENEWREWARD 1000
+
+// soups between updating the sampling weights
+#define ADAPTIVEUPDATE 1024
+
+// the learned results are halved after this many soups so old results fade out
+#define ADAPTIVEWINDOW 1048576
+
+// whether to tune the generation budget and the check interval while searching, with this on max-period is the largest budget it can pick
+// the budget follows how long soups take to end (and how long it took to confirm the ships that were found), and the check interval is whichever of half, the same or double gets through soups the fastest
+#define AUTOTUNE 0
+
+// smallest budget the auto-tuning can pick
+#define AUTOTUNEMINGENS 256
+
+// smallest and largest check intervals the auto-tuning can pick, it starts at CHECKINTERVAL
+#define AUTOTUNEMININTERVAL 16
+#define AUTOTUNEMAXINTERVAL 256
+
+// the budget is set so this fraction of the soups that end before it end in its last fifth
+// soups that never settle (and are cut off whatever the budget is) don't count
+#define AUTOTUNEMISS 0.01
+
+// soups to time each check interval with before comparing them, the intervals take turns so each one gets this many
+#define AUTOTUNESOUPS 256
+
+// number of threads (counting the main one) that share the generations of big soups, set to 1 to disable
+// each one runs a horizontal band of the bounding box, this only helps with really tall soups with lots of engines
+#define BANDTHREADS 1
+
+// soups only get split into bands once their bounding box has more cells than this, below it waking up the threads takes longer than they save
+#define BANDAREA 65536
+
 // uncomment to make it work in stupid online C compilers
 // #define BRUH
 
@@ -114,44 +204,318 @@ return '{' + out.join(', ') + '}';
 */
 const uint8_t transitions[512] = {0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1, 0, 1, 1, 0, 1, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 1, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 1, 1, 0, 0, 0, 1, 1, 0, 1, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 1, 0, 0, 0, 1, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 0, 0, 1, 1, 0, 1, 1, 0, 1, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 1, 1, 0, 1, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1, 1, 0, 0, 1, 0, 1, 0, 0, 1, 1, 0, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 0, 1, 0, 0, 1, 0, 1, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0, 1, 1, 1, 0, 1, 0, 1, 0, 0, 1, 0, 1, 1, 0, 0, 0, 1, 0, 1, 0, 1, 0, 0, 0, 0, 1, 0, 1, 1, 0, 0, 1, 0, 0, 1, 0, 1, 0, 1, 0, 1, 1, 0, 0, 1, 0, 1, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 1, 0, 1, 0, 0, 0, 1, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 1, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 1, 1, 1, 0, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 1, 0, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 0, 0, 1, 0, 1, 0, 1, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0, 1, 1, 0, 0, 1, 0, 1, 0, 1, 0, 0, 0, 1, 1, 1, 0, 0, 1, 0, 1, 1, 1, 0, 0, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1, 0, 0, 0, 1, 0, 0, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1};
 
-// DEBUG 1 logs every generation and bigger step
-// DEBUG 2 logs the state of the pattern as well
-// DEBUG 3 logs like everything
-#define DEBUG 0
+// tracing level to start with, it can also be set with -d and turned on and off with SIGUSR2
+// 1 logs every generation and bigger step
+// 2 logs the state of the pattern as well
+// 3 logs like everything
+#define TRACE 0
+
+// how many of the most recent soups are remembered, they're shown on SIGUSR1 or a crash so they can be run again with -r
+#define SOUPHISTORY 16
 
 // end parameters
 
 
+#if STATES > 2
+#undef PREFILTERGENS
+#define PREFILTERGENS 0
+#undef HASHLIFE
+#define HASHLIFE 0
+#undef BANDTHREADS
+#define BANDTHREADS 1
+#endif
+
+#ifdef BRUH
+#define THREADLOCAL
+#else
+#define THREADLOCAL _Thread_local
+#endif
+
+#ifdef __GNUC__
+#define ALWAYSINLINE __attribute__((always_inline))
+#else
+#define ALWAYSINLINE
+#endif
+
+// kernels for different instruction sets are only compiled on x86 with gcc or clang
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define X86KERNELS
+#endif
+
+
 #ifndef BRUH
 #include <unistd.h>
 #include <fcntl.h>
+#include <strings.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+#endif
+#endif
+
+// tracing
+
+// the level used when tracing is on
+uint16 trace_level = TRACE > 0 ? TRACE : 1;
+// SIGUSR2 turns this on and off
+volatile sig_atomic_t tracing = TRACE > 0;
+// only every nth soup is traced
+uint64 trace_every = 1;
+// the level for the current soup, 0 if it isn't being traced, other threads never trace
+THREADLOCAL uint16 soup_trace = TRACE;
+
+// this is checked in hot loops, so it should be a predictable branch when tracing is off
+#ifdef __GNUC__
+#define TRACING(level) __builtin_expect(soup_trace >= (level), 0)
+#else
+#define TRACING(level) (soup_trace >= (level))
+#endif
+
+void* traced_malloc(size_t size) {
+    void* out = malloc(size);
+    if (TRACING(3)) {
+        printf("Allocating %zu bytes: %p\n", size, out);
+    }
+    return out;
+}
+
+void traced_free(void* ptr) {
+    if (TRACING(3)) {
+        printf("Freeing %p\n", ptr);
+    }
+    free(ptr);
+}
+
+#define malloc(size) traced_malloc(size)
+#define free(ptr) traced_free(ptr)
+
+#ifndef BRUH
+void on_sigusr2(int something) {
+    tracing = !tracing;
+}
 #endif
 
-#if DEBUG > 2
-#define malloc(size) ({ \
-    printf("Allocating %lu bytes", (size)); \
-    void* out = malloc((size)); \
-    printf(": %p\n", out); \
-    out; \
-})
-#define free(ptr) ({ \
-    printf("Freeing %p\n", (ptr)); \
-    free((ptr)); \
-})
+// profiling
+
+#define STAGE_CREATE_SOUP 0
+#define STAGE_PREFILTER 1
+#define STAGE_RUN_GENERATION 2
+#define STAGE_CACHE_PHASE 3
+#define STAGE_CHECK_FOR_SPACESHIP 4
+#define STAGE_ADD_SHIP 5
+#define STAGES 6
+
+#define COUNTER_CYCLES 0
+#define COUNTER_INSTRUCTIONS 1
+#define COUNTER_L1D_MISSES 2
+#define COUNTER_LLC_MISSES 3
+#define COUNTER_BRANCH_MISSES 4
+#define COUNTERS 5
+
+#ifndef BRUH
+
+const char* stage_names[STAGES] = {"create_soup", "prefilter", "run_generation", "cache_phase", "check_for_spaceship", "add_ship"};
+
+bool profiling = false;
+// set by SIGUSR1, the profile and recent soups are shown after the current soup
+volatile sig_atomic_t status_requested = 0;
+// the counters are read all at once through the group leader
+int counter_leader = -1;
+// position of each counter in the group, -1 if it isn't available
+int16_t counter_slots[COUNTERS];
+uint16 counters_open = 0;
+
+uint64_t profile_start_time;
+uint64_t profile_start_counts[COUNTERS];
+uint64_t stage_calls[STAGES] = {0};
+uint64_t stage_time[STAGES] = {0};
+uint64_t stage_counts[STAGES][COUNTERS] = {{0}};
+// run_generation is too quick to read the counters around every call, so the generation loop is read once per soup
+// and whatever it spent that the stages inside it didn't claim goes to run_generation
+uint64_t loop_start_time;
+uint64_t loop_start_counts[COUNTERS];
+uint64_t loop_claimed_time;
+uint64_t loop_claimed_counts[COUNTERS];
+
+void init_profiling() {
+    profiling = true;
+    for (uint16 i = 0; i < COUNTERS; i++) {
+        counter_slots[i] = -1;
+    }
+    #ifdef __linux__
+    uint32_t types[COUNTERS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE};
+    uint64_t configs[COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    for (uint16 i = 0; i < COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[i];
+        attr.config = configs[i];
+        attr.disabled = counter_leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        int fd = syscall(__NR_perf_event_open, &attr, 0, -1, counter_leader, 0);
+        if (fd < 0) {
+            continue;
+        }
+        if (counter_leader < 0) {
+            counter_leader = fd;
+        }
+        counter_slots[i] = counters_open;
+        counters_open++;
+    }
+    if (counter_leader >= 0) {
+        ioctl(counter_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(counter_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    #endif
+    if (counters_open == 0) {
+        printf("Hardware performance counters are not available, profiling with timers only\n");
+    }
+}
+
+static inline void read_counters(uint64_t* time, uint64_t* counts) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    *time = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    if (counters_open > 0) {
+        uint64_t values[COUNTERS + 1];
+        if (read(counter_leader, values, sizeof(values)) > 0) {
+            for (uint16 i = 0; i < COUNTERS; i++) {
+                if (counter_slots[i] >= 0) {
+                    counts[i] = values[counter_slots[i] + 1];
+                }
+            }
+        }
+    }
+}
+
+static inline void profile_begin() {
+    if (profiling) {
+        read_counters(&profile_start_time, profile_start_counts);
+    }
+}
+
+static inline void profile_end(uint16 stage) {
+    if (profiling) {
+        uint64_t time;
+        uint64_t counts[COUNTERS] = {0};
+        read_counters(&time, counts);
+        stage_calls[stage]++;
+        stage_time[stage] += time - profile_start_time;
+        for (uint16 i = 0; i < COUNTERS; i++) {
+            stage_counts[stage][i] += counts[i] - profile_start_counts[i];
+        }
+    }
+}
+
+// adds up what every stage has spent so far
+static inline void claimed_totals(uint64_t* time, uint64_t* counts) {
+    *time = 0;
+    for (uint16 j = 0; j < COUNTERS; j++) {
+        counts[j] = 0;
+    }
+    for (uint16 i = 0; i < STAGES; i++) {
+        *time += stage_time[i];
+        for (uint16 j = 0; j < COUNTERS; j++) {
+            counts[j] += stage_counts[i][j];
+        }
+    }
+}
+
+static inline void profile_loop_begin() {
+    if (profiling) {
+        claimed_totals(&loop_claimed_time, loop_claimed_counts);
+        read_counters(&loop_start_time, loop_start_counts);
+    }
+}
+
+static inline void profile_loop_end(uint32 generations) {
+    if (profiling) {
+        uint64_t time;
+        uint64_t counts[COUNTERS] = {0};
+        read_counters(&time, counts);
+        uint64_t claimed_time;
+        uint64_t claimed_counts[COUNTERS];
+        claimed_totals(&claimed_time, claimed_counts);
+        stage_calls[STAGE_RUN_GENERATION] += generations;
+        stage_time[STAGE_RUN_GENERATION] += time - loop_start_time - (claimed_time - loop_claimed_time);
+        for (uint16 i = 0; i < COUNTERS; i++) {
+            stage_counts[STAGE_RUN_GENERATION][i] += counts[i] - loop_start_counts[i] - (claimed_counts[i] - loop_claimed_counts[i]);
+        }
+    }
+}
+
+void show_profile() {
+    uint64_t total_time = 0;
+    for (uint16 i = 0; i < STAGES; i++) {
+        total_time += stage_time[i];
+    }
+    printf("Profile (%s):\n", counters_open > 0 ? "hardware counters" : "timers only");
+    printf("%-20s %12s %10s %6s %10s %6s %9s %9s %9s\n", "stage", "calls", "seconds", "%", "ns/call", "IPC", "L1D MPKI", "LLC MPKI", "br MPKI");
+    for (uint16 i = 0; i < STAGES; i++) {
+        if (stage_calls[i] == 0) {
+            continue;
+        }
+        printf("%-20s %12"PRIu64" %10.3f %6.2f %10.1f", stage_names[i], stage_calls[i], (double)stage_time[i] / 1e9, total_time == 0 ? 0 : (double)stage_time[i] / (double)total_time * 100, (double)stage_time[i] / (double)stage_calls[i]);
+        uint64_t instructions = stage_counts[i][COUNTER_INSTRUCTIONS];
+        if (counter_slots[COUNTER_CYCLES] >= 0 && counter_slots[COUNTER_INSTRUCTIONS] >= 0 && stage_counts[i][COUNTER_CYCLES] > 0) {
+            printf(" %6.2f", (double)instructions / (double)stage_counts[i][COUNTER_CYCLES]);
+        } else {
+            printf(" %6s", "n/a");
+        }
+        // misses per thousand instructions
+        for (uint16 j = COUNTER_L1D_MISSES; j <= COUNTER_BRANCH_MISSES; j++) {
+            if (counter_slots[j] >= 0 && counter_slots[COUNTER_INSTRUCTIONS] >= 0 && instructions > 0) {
+                printf(" %9.3f", (double)stage_counts[i][j] / (double)instructions * 1000);
+            } else {
+                printf(" %9s", "n/a");
+            }
+        }
+        printf("\n");
+    }
+}
+
+void on_sigusr1(int something) {
+    status_requested = 1;
+}
+
+#else
+
+static inline void profile_begin() {}
+static inline void profile_end(uint16 stage) {}
+static inline void profile_loop_begin() {}
+static inline void profile_loop_end(uint32 generations) {}
+
 #endif
 
+
 uint32 engines;
 uint16 max_x_sep;
-uint16 max_period;
+// generations to run each soup for, this changes between soups when AUTOTUNE is on
+uint32 max_period;
+// generations between cached phases, this also changes between soups when AUTOTUNE is on
+uint32 check_interval = CHECKINTERVAL;
 bool use_random_soups;
 char* state_file;
 
 
-uint8_t data[SIZEVALUE] = {0};
-uint16 top = 0;
-uint16 bottom = 0;
-uint16 left = 0;
-uint16 right = 0;
+// the simulation state is per thread so patterns can be run on other threads (see classify)
+THREADLOCAL uint8_t data[SIZEVALUE] = {0};
+THREADLOCAL uint16 top = 0;
+THREADLOCAL uint16 bottom = 0;
+THREADLOCAL uint16 left = 0;
+THREADLOCAL uint16 right = 0;
 
 void clear() {
     uint32 stop = ((uint32)bottom << WIDTH) + left;
@@ -165,29 +529,37 @@ void clear() {
 }
 
 
-uint8_t temp_data[SIZEVALUE];
+#if STATES == 2
 
-static inline bool run_row(uint32 i, uint16* lowX, uint16* highX) {
+THREADLOCAL uint8_t temp_data[SIZEVALUE];
+
+// the 3 cell columns and transition indexes of the row being run
+THREADLOCAL uint16 row_columns[WIDTHVALUE + 2];
+THREADLOCAL uint16 row_indexes[WIDTHVALUE];
+
+// runs a row one cell at a time, with the neighborhood sliding along it
+// this is what the scalar and sse2 kernels use, since the split loops are only faster when they can be vectorized wide enough
+static inline ALWAYSINLINE bool run_row_sliding(uint8_t* grid, uint8_t* next, uint32 i, uint16 left, uint16 right, uint16* lowX, uint16* highX) {
     uint16 tr = 0;
-    tr |= (uint16)data[i - WIDTHVALUE - 1] << 5;
-    tr |= (uint16)data[i - 1] << 4;
-    tr |= (uint16)data[i + WIDTHVALUE - 1] << 3;
-    tr |= (uint16)data[i - WIDTHVALUE] << 2;
-    tr |= (uint16)data[i] << 1;
-    tr |= (uint16)data[i + WIDTHVALUE];
+    tr |= (uint16)grid[i - WIDTHVALUE - 1] << 5;
+    tr |= (uint16)grid[i - 1] << 4;
+    tr |= (uint16)grid[i + WIDTHVALUE - 1] << 3;
+    tr |= (uint16)grid[i - WIDTHVALUE] << 2;
+    tr |= (uint16)grid[i] << 1;
+    tr |= (uint16)grid[i + WIDTHVALUE];
     uint32 max = i - left + right + 1;
     uint8_t value;
     bool any_changed = false;
     uint16 x = left - 1;
     for (; i <= max; i++) {
         tr = (tr << 3) & 511;
-        tr |= (uint16)data[i - WIDTHVALUE + 1] << 2;
-        tr |= (uint16)data[i + 1] << 1;
-        tr |= (uint16)data[i + WIDTHVALUE + 1];
-        #if DEBUG > 2
-        printf("transition: %"PRIu8" %"PRIuFAST16" %"PRIu8"\n", data[i], tr, transitions[tr]);
-        #endif
+        tr |= (uint16)grid[i - WIDTHVALUE + 1] << 2;
+        tr |= (uint16)grid[i + 1] << 1;
+        tr |= (uint16)grid[i + WIDTHVALUE + 1];
         value = transitions[tr];
+        if (TRACING(3)) {
+            printf("transition: %"PRIu8" %"PRIuFAST16" %"PRIu8"\n", grid[i], tr, value);
+        }
         if (value) {
             any_changed = true;
             if (x < *lowX) {
@@ -197,34 +569,59 @@ static inline bool run_row(uint32 i, uint16* lowX, uint16* highX) {
                 *highX = x;
             }
         }
-        temp_data[i] = value;
+        next[i] = value;
         x++;
     }
     return any_changed;
 }
 
-bool run_generation() {
-    uint16 lowX = WIDTHVALUE;
-    uint16 highX = 0;
-    uint16 lowY = HEIGHTVALUE;
-    uint16 highY = 0;
-    bool any_changed;
-    uint32 i = ((top - 1) << WIDTH) + left - 1;
-    for (uint16 y = top - 1; y <= bottom; y++) {
-        #if DEBUG > 2
-        printf("i: %"PRIuFAST32"\n", i);
-        #endif
-        any_changed = run_row(i, &lowX, &highX);
-        if (any_changed) {
-            if (y < lowY) {
-                lowY = y;
-            }
-            if (y > highY) {
-                highY = y;
-            }
+// runs a row of grid from (left - 1) to right into next, i is the index of the first cell
+// if split is true this is split into simple loops so the index calculations can be vectorized
+static inline ALWAYSINLINE bool run_row(uint8_t* grid, uint8_t* next, uint32 i, uint16 left, uint16 right, uint16* lowX, uint16* highX, bool split) {
+    if (!split) {
+        return run_row_sliding(grid, next, i, left, right, lowX, highX);
+    }
+    uint16 count = right - left + 2;
+    uint8_t* above = grid + i - WIDTHVALUE - 1;
+    uint8_t* row = grid + i - 1;
+    uint8_t* below = grid + i + WIDTHVALUE - 1;
+    for (uint16 x = 0; x < count + 2; x++) {
+        row_columns[x] = (above[x] << 2) | (row[x] << 1) | below[x];
+    }
+    for (uint16 x = 0; x < count; x++) {
+        row_indexes[x] = (row_columns[x] << 6) | (row_columns[x + 1] << 3) | row_columns[x + 2];
+    }
+    uint8_t* out = next + i;
+    for (uint16 x = 0; x < count; x++) {
+        out[x] = transitions[row_indexes[x]];
+    }
+    if (TRACING(3)) {
+        for (uint16 x = 0; x < count; x++) {
+            printf("transition: %"PRIu8" %"PRIuFAST16" %"PRIu8"\n", row[x + 1], row_indexes[x], out[x]);
         }
-        i += WIDTHVALUE;
     }
+    uint16 first = 0;
+    while (first < count && !out[first]) {
+        first++;
+    }
+    if (first == count) {
+        return false;
+    }
+    uint16 last = count - 1;
+    while (!out[last]) {
+        last--;
+    }
+    if (left - 1 + first < *lowX) {
+        *lowX = left - 1 + first;
+    }
+    if (left - 1 + last > *highX) {
+        *highX = left - 1 + last;
+    }
+    return true;
+}
+
+// clears the old bounding box and copies the new one from temp_data
+static inline ALWAYSINLINE bool finish_generation(uint16 lowX, uint16 highX, uint16 lowY, uint16 highY) {
     // idk why this is needed, someone should figure out why because this probably slows it down
     clear();
     top = lowY;
@@ -242,389 +639,2102 @@ bool run_generation() {
     return lowX < highX;
 }
 
+#if BANDTHREADS > 1 && !defined(BRUH)
 
-typedef struct engine_phase {
-    uint32 height;
-    uint32 width;
-    uint8_t data[];
-} engine_phase;
+/*
+banded generations
+the rows from (top - 1) to bottom are split into one band per thread, and each thread runs its band from the main thread's data into the main thread's temp_data
+the rows just outside a band are read straight from data, so nothing has to be passed between the threads
+once a thread is done it copies its rows back into data, except for its first and last rows, since the bands next to it might still be reading those
+the main thread copies those after every band is done and merges the bounding boxes of the bands
+the rows that get copied are the whole area that was run, so that clears the old bounding box too
+*/
 
-engine_phase* engine_phases[ENGINEPHASES];
+typedef struct {
+    // data and temp_data of the main thread
+    uint8_t* grid;
+    uint8_t* next;
+    uint16 left;
+    uint16 right;
+    // the rows of the band, to is the row after the last one
+    uint16 from;
+    uint16 to;
+    // the bounding box of what the band made
+    uint16 lowX;
+    uint16 highX;
+    uint16 lowY;
+    uint16 highY;
+} band;
 
-void generate_phases() {
-    clear();
-    put_engine(data, (STARTY << WIDTH) + STARTX);
-    top = STARTY;
-    bottom = STARTY + ENGINEHEIGHT;
-    left = STARTX;
-    right = STARTX + ENGINEWIDTH;
-    for (uint16 i = 0; i < ENGINEPHASES; i++) {
-        #if DEBUG > 0
-        printf("Generating phase %"PRIuFAST16"\n", i);
-        #endif
-        uint16 height = bottom - top;
-        uint16 width = right - left;
-        uint32 size = height * width;
-        // printf("Size: %"PRIuFAST32", Total size: %lu\n", size, sizeof(engine_phase) + size);
-        engine_phase* phase = malloc(sizeof(engine_phase) + size);
-        phase->height = height;
-        phase->width = width;
-        uint32 j = 0;
-        uint32 stop = ((uint32)bottom << WIDTH) + left;
-        uint32 max = ((uint32)top << WIDTH) + right;
-        for (uint32 start = (top << WIDTH) + left; start < stop; start += WIDTHVALUE) {
-            for (uint32 i = start; i < max; i++) {
-                // printf("%"PRIuFAST32"\n", j);
-                phase->data[j] = data[i];
-                j++;
+band bands[BANDTHREADS];
+
+// only the main thread uses the bands, the classify and minimize threads run their soups by themselves
+THREADLOCAL bool use_bands = false;
+
+pthread_mutex_t band_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t band_start = PTHREAD_COND_INITIALIZER;
+pthread_cond_t band_finished = PTHREAD_COND_INITIALIZER;
+// goes up by 1 every time the bands are started
+uint64 band_generation = 0;
+// number of band threads that haven't finished yet (the main thread doesn't count)
+uint16 bands_running = 0;
+
+// the band kernel, this gets compiled for each instruction set (see init_kernels)
+static inline ALWAYSINLINE void run_band_kernel(band* b, bool split) {
+    b->lowX = WIDTHVALUE;
+    b->highX = 0;
+    b->lowY = HEIGHTVALUE;
+    b->highY = 0;
+    uint32 i = ((uint32)b->from << WIDTH) + b->left - 1;
+    for (uint16 y = b->from; y < b->to; y++) {
+        if (TRACING(3)) {
+            printf("i: %"PRIuFAST32"\n", i);
+        }
+        if (run_row(b->grid, b->next, i, b->left, b->right, &b->lowX, &b->highX, split)) {
+            if (y < b->lowY) {
+                b->lowY = y;
+            }
+            if (y > b->highY) {
+                b->highY = y;
             }
-            max += WIDTHVALUE;
         }
-        // printf("Placing phase %"PRIuFAST16"\n", i);
-        engine_phases[i] = phase;
-        run_generation();
+        i += WIDTHVALUE;
     }
-    #if DEBUG > 0
-    printf("Phases generated\n");
-    #endif
-}
-
-
-static inline uint64_t rotl(const uint64_t x, int k) {
-	return (x << k) | (x >> (64 - k));
 }
 
-uint64_t rng_state[4];
+void (*run_band)(band* b);
 
-uint64_t rng() {
-    #define s rng_state
-	const uint64_t result = rotl(s[1] * 5, 7) * 9;
-	const uint64_t t = s[1] << 17;
-	s[2] ^= s[0];
-	s[3] ^= s[1];
-	s[1] ^= s[2];
-	s[0] ^= s[3];
-	s[2] ^= t;
-	s[3] = rotl(s[3], 45);
-    #undef s
-	return result;
+// copies the rows from (from) to (to - 1) of the area the band ran from temp_data into data
+void copy_band_rows(band* b, uint16 from, uint16 to) {
+    uint32 i = ((uint32)from << WIDTH) + b->left - 1;
+    uint16 width = b->right - b->left + 2;
+    for (uint16 y = from; y < to; y++) {
+        memcpy(b->grid + i, b->next + i, width);
+        i += WIDTHVALUE;
+    }
 }
 
-#ifndef BRUH
-void init_rng() {
-    int fd = open("/dev/urandom", O_RDONLY);
-    if (fd < 0) {
-        perror("Error opening /dev/urandom");
-        exit(1);
-    }
-    ssize_t size = read(fd, rng_state, 4 * sizeof(uint64_t));
-    if (size < (ssize_t)(4 * sizeof(uint64_t))) {
-        perror("Error reading /dev/urandom");
-        close(fd);
-        exit(1);
+void* band_worker(void* arg) {
+    band* b = arg;
+    // signals should go to the main thread
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    soup_trace = 0;
+    uint64 seen = 0;
+    pthread_mutex_lock(&band_lock);
+    while (true) {
+        while (band_generation == seen) {
+            pthread_cond_wait(&band_start, &band_lock);
+        }
+        seen = band_generation;
+        pthread_mutex_unlock(&band_lock);
+        run_band(b);
+        copy_band_rows(b, b->from + 1, b->to - 1);
+        pthread_mutex_lock(&band_lock);
+        bands_running--;
+        if (bands_running == 0) {
+            pthread_cond_signal(&band_finished);
+        }
     }
-    close(fd);
+    return NULL;
 }
-#else
-void init_rng() {
-    printf("Enter random seed: ");
-    scanf("%"PRIu64, rng_state);
-    rng_state[1] = 0x0123456789ABCDEF;
-    rng_state[2] = 0x5555555555555555;
-    rng_state[3] = 0x0F1E2D3C4B5A6978;
-    for (int i = 0; i < 128; i++) {
-        rng();
+
+void init_bands() {
+    for (uint16 i = 1; i < BANDTHREADS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, band_worker, &bands[i]) != 0) {
+            perror("Error starting band thread");
+            exit(1);
+        }
+        pthread_detach(thread);
     }
+    use_bands = true;
 }
-#endif
 
-
-uint16 randint(uint16 range) {
-    if (range == 0) {
-        return 0;
+bool run_generation_banded() {
+    uint16 rows = bottom - top + 2;
+    for (uint16 i = 0; i < BANDTHREADS; i++) {
+        band* b = &bands[i];
+        b->grid = data;
+        b->next = temp_data;
+        b->left = left;
+        b->right = right;
+        b->from = top - 1 + (uint32)rows * i / BANDTHREADS;
+        b->to = top - 1 + (uint32)rows * (i + 1) / BANDTHREADS;
     }
-    uint32_t value = rng();
-    uint32_t max = ((((uint64_t)1 << 32) - 1) / (uint64_t)range) * (uint64_t)range;
-    while (value > max) {
-        value = rng();
+    pthread_mutex_lock(&band_lock);
+    bands_running = BANDTHREADS - 1;
+    band_generation++;
+    pthread_cond_broadcast(&band_start);
+    pthread_mutex_unlock(&band_lock);
+    run_band(&bands[0]);
+    copy_band_rows(&bands[0], bands[0].from + 1, bands[0].to - 1);
+    pthread_mutex_lock(&band_lock);
+    while (bands_running > 0) {
+        pthread_cond_wait(&band_finished, &band_lock);
     }
-    uint16 out = value % range;
-    if (out >= range) {
-        return randint(range);
-    } else {
-        return out;
+    pthread_mutex_unlock(&band_lock);
+    uint16 lowX = WIDTHVALUE;
+    uint16 highX = 0;
+    uint16 lowY = HEIGHTVALUE;
+    uint16 highY = 0;
+    for (uint16 i = 0; i < BANDTHREADS; i++) {
+        band* b = &bands[i];
+        if (b->from < b->to) {
+            copy_band_rows(b, b->from, b->from + 1);
+            if (b->to - 1 > b->from) {
+                copy_band_rows(b, b->to - 1, b->to);
+            }
+        }
+        if (b->lowX < lowX) {
+            lowX = b->lowX;
+        }
+        if (b->highX > highX) {
+            highX = b->highX;
+        }
+        if (b->lowY < lowY) {
+            lowY = b->lowY;
+        }
+        if (b->highY > highY) {
+            highY = b->highY;
+        }
     }
+    // the bands already did the rest of finish_generation
+    top = lowY;
+    bottom = highY + 1;
+    left = lowX;
+    right = highX + 1;
+    return lowX < highX;
 }
 
-uint8_t initial_pattern[SIZEVALUE];
-uint16 ip_bottom = 0;
-uint16 ip_right = 0;
+#endif
 
-typedef struct engine_info {
-    uint16 x;
-    uint16 y;
-    uint16 phase;
-} engine_info;
+// the generation kernel, this gets compiled for each instruction set (see init_kernels)
+static inline ALWAYSINLINE bool run_generation_kernel(bool split) {
+    #if BANDTHREADS > 1 && !defined(BRUH)
+    if (use_bands && (uint32)(bottom - top) * (right - left) > BANDAREA) {
+        return run_generation_banded();
+    }
+    #endif
+    uint16 lowX = WIDTHVALUE;
+    uint16 highX = 0;
+    uint16 lowY = HEIGHTVALUE;
+    uint16 highY = 0;
+    bool any_changed;
+    uint32 i = ((top - 1) << WIDTH) + left - 1;
+    for (uint16 y = top - 1; y <= bottom; y++) {
+        if (TRACING(3)) {
+            printf("i: %"PRIuFAST32"\n", i);
+        }
+        any_changed = run_row(data, temp_data, i, left, right, &lowX, &highX, split);
+        if (any_changed) {
+            if (y < lowY) {
+                lowY = y;
+            }
+            if (y > highY) {
+                highY = y;
+            }
+        }
+        i += WIDTHVALUE;
+    }
+    return finish_generation(lowX, highX, lowY, highY);
+}
 
-engine_info* global_engines;
+#else
 
-void create_soup() {
-    clear();
-    uint32 stop = ((uint32)ip_bottom << WIDTH) + STARTX;
-    uint32 max = (STARTY << WIDTH) + ip_right;
-    for (uint32 start = (STARTY << WIDTH) + STARTX; start < stop; start += WIDTHVALUE) {
-        for (uint32 i = start; i < max; i++) {
-            data[i] = 0;
+/*
+multistate kernel
+the grid is stored as 2 bit planes with 64 cells per word, and the transitions table is turned into a binary decision diagram that gets evaluated on whole words at once
+data is only updated when something needs it (see unpack_data)
+*/
+
+// words in each row of a bit plane, there's padding on both sides so whole chunks can be read and written
+#define CHUNK 4
+#define WORDS ((WIDTHVALUE >> 6) + CHUNK + 1)
+#define PLANEROW(y) ((uint32)(y) * WORDS + 1)
+
+THREADLOCAL uint64_t planes[2][2][HEIGHTVALUE * WORDS];
+THREADLOCAL uint16 current_planes = 0;
+
+// the part of the current planes that might have cells in it
+THREADLOCAL uint16 plane_top = 0;
+THREADLOCAL uint16 plane_bottom = 0;
+THREADLOCAL uint16 plane_left = 0;
+THREADLOCAL uint16 plane_right = 0;
+
+typedef struct bdd_node {
+    // the bit of the transitions index that this node tests
+    uint16 bit;
+    uint16 low;
+    uint16 high;
+} bdd_node;
+
+// nodes 0 and 1 are the constants, every node comes after its children
+bdd_node bdd[514];
+uint16 bdd_size = 2;
+uint16 bdd_root;
+
+uint16 make_bdd_node(uint16 bit, uint16 low, uint16 high) {
+    if (low == high) {
+        return low;
+    }
+    for (uint16 i = 2; i < bdd_size; i++) {
+        if (bdd[i].bit == bit && bdd[i].low == low && bdd[i].high == high) {
+            return i;
         }
-        max += WIDTHVALUE;
     }
-    uint16 y;
-    uint16 x;
-    engine_phase* phase;
-    // clock_t start = clock();
-    if (use_random_soups) {
-        top = STARTY;
-        bottom = 0;
-        left = STARTX;
-        right = 0;
-        x = STARTY;
-        y = STARTX;
-        for (uint16 i = 0; i < engines; i++) {
-            phase = engine_phases[randint(ENGINEPHASES)];
-            // idk why this is needed, someone should figure out why because this probably slows it down
-            if (phase == NULL) {
-                generate_phases();
-                create_soup();
-                return;
-            }
-            uint16 j = 0;
-            for (uint16 cy = 0; cy < phase->height; cy++) {
-                uint32 i = ((uint32)(y + cy) << WIDTH) + x;
-                for (uint16 cx = 0; cx < phase->width; cx++) {
-                    initial_pattern[i] = phase->data[j];
-                    i++;
-                    j++;
-                }
-            }
-            if (x + phase->width > right) {
-                right = x + phase->width;
-            }
-            if (y + phase->height > bottom) {
-                bottom = y + phase->height;
+    bdd[bdd_size].bit = bit;
+    bdd[bdd_size].low = low;
+    bdd[bdd_size].high = high;
+    return bdd_size++;
+}
+
+// builds the decision diagram for transitions[start] to transitions[start + 2^bits - 1]
+uint16 build_bdd(uint16 start, uint16 bits) {
+    if (bits == 0) {
+        return transitions[start];
+    }
+    bits--;
+    uint16 low = build_bdd(start, bits);
+    uint16 high = build_bdd(start + (1 << bits), bits);
+    return make_bdd_node(bits, low, high);
+}
+
+THREADLOCAL uint64_t bdd_values[514][CHUNK];
+
+void init_bdd() {
+    bdd_root = build_bdd(0, 9);
+}
+
+// copies the pattern in data into the bit planes
+void pack_data() {
+    uint64_t* p0 = planes[current_planes][0];
+    uint64_t* p1 = planes[current_planes][1];
+    if (plane_top < plane_bottom) {
+        for (uint16 y = plane_top; y < plane_bottom; y++) {
+            for (uint32 w = PLANEROW(y) + (plane_left >> 6); w <= PLANEROW(y) + ((plane_right - 1) >> 6); w++) {
+                p0[w] = 0;
+                p1[w] = 0;
             }
-            x = STARTX + randint(max_x_sep);
-            y += MINY + randint(MAXY - MINY + 1);
         }
-    } else {
-        top = STARTY;
-        bottom = 0;
-        left = STARTX;
-        right = 0;
-        y = STARTY;
-        for (uint16 i = 0; i < engines; i++) {
-            engine_info engine = global_engines[i];
-            y += engine.y;
-            phase = engine_phases[engine.phase];
-            // #if DEBUG > 0
-            // printf("Placing phase %"PRIuFAST16" at x = %"PRIuFAST16", y = %"PRIuFAST16"\n", engine.phase, engine.x + STARTX, engine.y + y);
-            // #endif
-            for (uint16 cy = 0; cy < phase->height; cy++) {
-                uint32 i = ((y + cy) << WIDTH) + STARTX + engine.x;
-                uint16 j = cy * phase->width;
-                uint16 end = j + phase->height;
-                for (; j < end; j++) {
-                    initial_pattern[i] = phase->data[j];
-                    i++;
+    }
+    for (uint16 y = top; y < bottom; y++) {
+        uint32 i = ((uint32)y << WIDTH);
+        for (uint16 x = left; x < right; x++) {
+            uint8_t value = data[i + x];
+            p0[PLANEROW(y) + (x >> 6)] |= (uint64_t)(value & 1) << (x & 63);
+            p1[PLANEROW(y) + (x >> 6)] |= (uint64_t)(value >> 1) << (x & 63);
+        }
+    }
+    plane_top = top;
+    plane_bottom = bottom;
+    plane_left = left;
+    plane_right = right;
+}
+
+// copies the part of the bit planes in the bounding box into data
+void unpack_data() {
+    uint64_t* p0 = planes[current_planes][0];
+    uint64_t* p1 = planes[current_planes][1];
+    for (uint16 y = top; y < bottom; y++) {
+        uint32 i = ((uint32)y << WIDTH);
+        for (uint16 x = left; x < right; x++) {
+            uint32 w = PLANEROW(y) + (x >> 6);
+            data[i + x] = ((p0[w] >> (x & 63)) & 1) | (((p1[w] >> (x & 63)) & 1) << 1);
+        }
+    }
+}
+
+// the generation kernel, this gets compiled for each instruction set (see init_kernels)
+// split is only used by the 2 state kernel
+static inline ALWAYSINLINE bool run_generation_kernel(bool split) {
+    uint64_t* p0 = planes[current_planes][0];
+    uint64_t* p1 = planes[current_planes][1];
+    uint64_t* n0 = planes[!current_planes][0];
+    uint64_t* n1 = planes[!current_planes][1];
+    uint16 lowX = WIDTHVALUE;
+    uint16 highX = 0;
+    uint16 lowY = HEIGHTVALUE;
+    uint16 highY = 0;
+    uint32 first = (left - 1) >> 6;
+    uint32 last = right >> 6;
+    uint64_t inputs[9][CHUNK];
+    // the constants, these are set here since every thread has its own bdd_values
+    for (uint16 j = 0; j < CHUNK; j++) {
+        bdd_values[0][j] = 0;
+        bdd_values[1][j] = ~(uint64_t)0;
+    }
+    for (uint16 y = top - 1; y <= bottom; y++) {
+        bool any = false;
+        for (uint32 w = first; w <= last; w += CHUNK) {
+            // the live cells around each cell, in the same order as the transitions index
+            for (uint16 r = 0; r < 3; r++) {
+                uint32 row = PLANEROW(y + r - 1) + w;
+                for (uint16 j = 0; j < CHUNK; j++) {
+                    uint64_t alive = p0[row + j] & ~p1[row + j];
+                    uint64_t before = p0[row + j - 1] & ~p1[row + j - 1];
+                    uint64_t after = p0[row + j + 1] & ~p1[row + j + 1];
+                    inputs[8 - r][j] = (alive << 1) | (before >> 63);
+                    inputs[5 - r][j] = alive;
+                    inputs[2 - r][j] = (alive >> 1) | (after << 63);
                 }
             }
-            if (STARTX + engine.x + phase->width > right) {
-                right = STARTX + engine.x + phase->width;
-            }
-            if (STARTY + engine.y + phase->height > bottom) {
-                bottom = STARTY + engine.y + phase->height;
+            for (uint16 n = 2; n < bdd_size; n++) {
+                uint64_t* in = inputs[bdd[n].bit];
+                uint64_t* low = bdd_values[bdd[n].low];
+                uint64_t* high = bdd_values[bdd[n].high];
+                for (uint16 j = 0; j < CHUNK; j++) {
+                    bdd_values[n][j] = low[j] ^ (in[j] & (low[j] ^ high[j]));
+                }
             }
-        }
-        for (uint16 i = engines - 1; i >= 0; i++) {
-            engine_info engine = global_engines[i];
-            if (i == 0) {
-                engine.phase = (engine.phase + 1) % ENGINEPHASES;
-            } else {
-                if (engine.y != MAXY) {
-                    engine.y++;
-                    break;
-                } else {
-                    engine.y = MINY;
-                    if (engine.x != STARTX + max_x_sep) {
-                        engine.x++;
-                        break;
-                    } else {
-                        engine.x = STARTX;
-                        engine.phase = (engine.phase + 1) % ENGINEPHASES;
+            uint64_t* result = bdd_values[bdd_root];
+            uint32 row = PLANEROW(y) + w;
+            for (uint16 j = 0; j < CHUNK; j++) {
+                uint64_t c0 = p0[row + j];
+                uint64_t c1 = p1[row + j];
+                // dead and live cells can become live, dying cells can't
+                uint64_t born = result[j] & ~c1;
+                #if STATES == 3
+                uint64_t r0 = born;
+                uint64_t r1 = c0 & ~born;
+                #else
+                uint64_t aging = (c0 | c1) & ~born;
+                uint64_t r0 = born | (aging & ~c0);
+                uint64_t r1 = aging & (c0 ^ c1);
+                #endif
+                n0[row + j] = r0;
+                n1[row + j] = r1;
+                uint64_t cells = r0 | r1;
+                if (cells && w + j <= last) {
+                    any = true;
+                    uint16 x = (w + j) << 6;
+                    if (x + __builtin_ctzll(cells) < lowX) {
+                        lowX = x + __builtin_ctzll(cells);
+                    }
+                    if (x + 63 - __builtin_clzll(cells) > highX) {
+                        highX = x + 63 - __builtin_clzll(cells);
                     }
                 }
             }
         }
+        if (any) {
+            if (y < lowY) {
+                lowY = y;
+            }
+            highY = y;
+        }
     }
-    stop = ((uint32)bottom << WIDTH) + left;
-    max = ((uint32)top << WIDTH) + right;
-    for (uint32 start = (top << WIDTH) + left; start < stop; start += WIDTHVALUE) {
-        for (uint32 i = start; i < max; i++) {
-            data[i] = initial_pattern[i];
+    for (uint16 y = top; y < bottom; y++) {
+        for (uint32 w = PLANEROW(y) + first; w <= PLANEROW(y) + last; w++) {
+            p0[w] = 0;
+            p1[w] = 0;
         }
-        max += WIDTHVALUE;
     }
-    ip_bottom = bottom;
-    ip_right = right;
-    // printf("Generated soup in %.3f seconds\n", ((double)clock() - (double)start) / CLOCKS_PER_SEC);
+    current_planes = !current_planes;
+    top = lowY;
+    bottom = highY + 1;
+    left = lowX;
+    right = highX + 1;
+    plane_top = top;
+    plane_bottom = bottom;
+    plane_left = left;
+    plane_right = right;
+    return lowX < highX;
 }
 
+#endif
 
-typedef struct pattern_data {
-    uint16 top;
-    uint16 left;
+
+bool (*run_generation)();
+
+
+typedef struct engine_phase {
+    uint32 height;
+    uint32 width;
+    uint8_t data[];
+} engine_phase;
+
+engine_phase* engine_phases[ENGINEPHASES];
+
+// the phases as rows of 8-cell words, at each of the 8 offsets from a word boundary, so soups can be made a word at a time
+// mask has the cells in the box of the phase
+typedef struct engine_stamp {
     uint16 height;
-    uint16 width;
-    uint32 size;
-    uint32 population;
-    uint64_t hash;
-    uint32_t data[];
-} pattern_data;
+    uint16 words;
+    uint64_t* bits;
+    uint64_t* mask;
+} engine_stamp;
 
-uint32 phase_number;
-pattern_data** phase_cache;
+engine_stamp engine_stamps[ENGINEPHASES][8];
 
-void cache_phase() {
-    uint16 height = bottom - top;
-    uint16 width = right - left;
-    uint32 size = height * width;
-    uint32 population = 0;
-    uint32 data_length = size >> 5;
-    if (size % 32 != 0) {
-        data_length++;
-    }
-    if (data_length == 0) {
-        data_length = 1;
-    }
-    // printf("height = %"PRIuFAST16", width = %"PRIuFAST16", data_length = %"PRIuFAST32"\n", height, width, data_length);
-    pattern_data* out = malloc(sizeof(pattern_data) + data_length * sizeof(uint32_t));
-    // printf("%"PRIuFAST16" %"PRIuFAST16" %"PRIuFAST32"\n", ip_bottom, ip_right, data_length);
-    out->top = top;
-    out->left = left;
-    out->height = height;
-    out->width = width;
-    out->size = size;
-    for (uint32 i = 0; i < data_length; i++) {
-        out->data[i] = 0;
+void free_stamps() {
+    for (uint16 i = 0; i < ENGINEPHASES; i++) {
+        for (uint16 shift = 0; shift < 8; shift++) {
+            free(engine_stamps[i][shift].bits);
+            free(engine_stamps[i][shift].mask);
+            engine_stamps[i][shift].bits = NULL;
+            engine_stamps[i][shift].mask = NULL;
+        }
     }
-    uint32 data_i = 0;
-    uint16 bit_number = 0;
-    uint32 stop = ((uint32)bottom << WIDTH) + left;
-    uint32 max = ((uint32)top << WIDTH) + right;
-    uint32 num_cells = 0;
-    for (uint32 start = (top << WIDTH) + left; start < stop; start += WIDTHVALUE) {
-        for (uint32 i = start; i < max; i++) {
-            // if (data_i > data_length) {
-            //     printf("you are probably writing past the array bounds ");
-            // }
-            if (data[i]) {
-                population++;
-            }
-            out->data[data_i] |= data[i] << bit_number;
-            bit_number++;
-            if (bit_number == 32) {
-                bit_number = 0;
-                data_i++;
+}
+
+void make_stamps() {
+    free_stamps();
+    for (uint16 i = 0; i < ENGINEPHASES; i++) {
+        engine_phase* phase = engine_phases[i];
+        for (uint16 shift = 0; shift < 8; shift++) {
+            engine_stamp* stamp = &engine_stamps[i][shift];
+            stamp->height = phase->height;
+            stamp->words = (shift + phase->width + 7) / 8;
+            stamp->bits = calloc((uint32)stamp->height * stamp->words, sizeof(uint64_t));
+            stamp->mask = calloc((uint32)stamp->height * stamp->words, sizeof(uint64_t));
+            // the rows are filled in as bytes, so this doesn't depend on byte order
+            uint8_t* bits = (uint8_t*)stamp->bits;
+            uint8_t* mask = (uint8_t*)stamp->mask;
+            for (uint16 y = 0; y < phase->height; y++) {
+                uint32 row = (uint32)y * stamp->words * 8 + shift;
+                memcpy(bits + row, phase->data + y * phase->width, phase->width);
+                memset(mask + row, 0xFF, phase->width);
             }
-            num_cells++;
-            // printf("%"PRIuFAST32" ", num_cells);
         }
-        max += WIDTHVALUE;
     }
-    // printf("\n");
-    uint64_t hash = 0;
-    for (uint32 i = 0; i < data_length; i += 4) {
-        hash += (uint64_t)out->data[i] << 32;
-        if (data_length - i > 4) {
-            hash += (uint64_t)out->data[i + 1];
-            hash ^= (uint64_t)out->data[i + 2] << 32;
-            hash ^= (uint64_t)out->data[i + 3];
-        } else if (i + 1 < data_length) {
-            hash += (uint64_t)out->data[i + 1];
-            if (i + 2 < data_length) {
-                hash ^= (uint64_t)out->data[i + 2] << 32;
-                if (i + 3 < data_length) {
-                    hash ^= (uint64_t)out->data[i + 3];
-                }
+}
+
+void generate_phases() {
+    clear();
+    put_engine(data, (STARTY << WIDTH) + STARTX);
+    top = STARTY;
+    bottom = STARTY + ENGINEHEIGHT;
+    left = STARTX;
+    right = STARTX + ENGINEWIDTH;
+    #if STATES > 2
+    pack_data();
+    #endif
+    for (uint16 i = 0; i < ENGINEPHASES; i++) {
+        if (TRACING(1)) {
+            printf("Generating phase %"PRIuFAST16"\n", i);
+        }
+        uint16 height = bottom - top;
+        uint16 width = right - left;
+        uint32 size = height * width;
+        // printf("Size: %"PRIuFAST32", Total size: %lu\n", size, sizeof(engine_phase) + size);
+        engine_phase* phase = malloc(sizeof(engine_phase) + size);
+        phase->height = height;
+        phase->width = width;
+        uint32 j = 0;
+        uint32 stop = ((uint32)bottom << WIDTH) + left;
+        uint32 max = ((uint32)top << WIDTH) + right;
+        for (uint32 start = (top << WIDTH) + left; start < stop; start += WIDTHVALUE) {
+            for (uint32 i = start; i < max; i++) {
+                // printf("%"PRIuFAST32"\n", j);
+                phase->data[j] = data[i];
+                j++;
             }
+            max += WIDTHVALUE;
         }
-        hash = (hash << 16) | (hash >> 48);
+        // printf("Placing phase %"PRIuFAST16"\n", i);
+        engine_phases[i] = phase;
+        run_generation();
+        #if STATES > 2
+        unpack_data();
+        #endif
+    }
+    make_stamps();
+    if (TRACING(1)) {
+        printf("Phases generated\n");
     }
-    out->hash = hash;
-    out->population = population;
-    phase_cache[phase_number] = out;
 }
 
 
-#if REDUCEPERIOD > 0
-uint16 gcd(uint16 a, uint16 b) {
-    while (b != 0) {
-        uint16 temp = b;
-        b = a % b;
-        a = temp;
+static inline uint64_t rotl(const uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+// the seed, and the generator that the lanes are started from
+uint64_t rng_seed[4];
+uint64_t rng_state[4];
+
+// one step of xoshiro256**, only used to seed the lanes
+uint64_t rng_step() {
+    #define s rng_state
+	const uint64_t result = rotl(s[1] * 5, 7) * 9;
+	const uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+    #undef s
+	return result;
+}
+
+// random numbers are made RNGBATCH at a time by RNGLANES xoshiro256** generators side by side, so the loop gets vectorized
+#define RNGLANES 8
+#define RNGBATCH 256
+
+uint64_t rng_lanes[4][RNGLANES];
+uint64_t rng_buffer[RNGBATCH];
+uint16 rng_index = RNGBATCH;
+// number of batches made so far, so positions in the stream can be shown
+uint64_t rng_batches = 0;
+
+// this gets compiled for each instruction set
+static inline ALWAYSINLINE void fill_rng_kernel() {
+    for (uint16 i = 0; i < RNGBATCH; i += RNGLANES) {
+        for (uint16 j = 0; j < RNGLANES; j++) {
+            uint64_t s1 = rng_lanes[1][j];
+            rng_buffer[i + j] = rotl(s1 * 5, 7) * 9;
+            uint64_t t = s1 << 17;
+            rng_lanes[2][j] ^= rng_lanes[0][j];
+            rng_lanes[3][j] ^= s1;
+            rng_lanes[1][j] = s1 ^ rng_lanes[2][j];
+            rng_lanes[0][j] ^= rng_lanes[3][j];
+            rng_lanes[2][j] ^= t;
+            rng_lanes[3][j] = rotl(rng_lanes[3][j], 45);
+        }
     }
-    return a;
 }
-#endif
 
-uint64_t check_for_spaceship() {
-    pattern_data* data;
-    pattern_data* current = phase_cache[phase_number];
-    uint16 period = CHECKINTERVAL;
-    // printf("Checking\n");
-    for (uint16 i = phase_number - 1; i < UINT_FAST16_MAX; i--) {
-        data = phase_cache[i];
-        // printf("Checking generation %"PRIuFAST16" %"PRIuFAST32" %"PRIuFAST32"\n", i, current->population, data->population);
-        if (current->hash == data->hash && current->population == data->population && current->height == data->height && current->width == data->width) {
-            // #if DEBUG > 0
-            // printf("Match found\n");
-            // #endif
-            for (uint16 i = 0; i < current->size >> 5; i++) {
-                if (current->data[i] != data->data[i]) {
-                    goto not_found;
-                }
+void (*fill_rng)();
+
+static inline uint64_t rng() {
+    if (rng_index == RNGBATCH) {
+        fill_rng();
+        rng_index = 0;
+        rng_batches++;
+    }
+    return rng_buffer[rng_index++];
+}
+
+// how many random numbers have been used
+uint64_t rng_position() {
+    return rng_batches * RNGBATCH + rng_index - RNGBATCH;
+}
+
+void seed_rng() {
+    memcpy(rng_seed, rng_state, sizeof(rng_seed));
+    for (uint16 i = 0; i < 4; i++) {
+        for (uint16 j = 0; j < RNGLANES; j++) {
+            rng_lanes[i][j] = rng_step();
+        }
+    }
+}
+
+#ifndef BRUH
+void init_rng() {
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening /dev/urandom");
+        exit(1);
+    }
+    ssize_t size = read(fd, rng_state, 4 * sizeof(uint64_t));
+    if (size < (ssize_t)(4 * sizeof(uint64_t))) {
+        perror("Error reading /dev/urandom");
+        close(fd);
+        exit(1);
+    }
+    close(fd);
+    seed_rng();
+}
+#else
+void init_rng() {
+    printf("Enter random seed: ");
+    scanf("%"PRIu64, rng_state);
+    rng_state[1] = 0x0123456789ABCDEF;
+    rng_state[2] = 0x5555555555555555;
+    rng_state[3] = 0x0F1E2D3C4B5A6978;
+    for (int i = 0; i < 128; i++) {
+        rng_step();
+    }
+    seed_rng();
+}
+#endif
+
+
+// lemire's method, the division only happens when the value might have to be rejected
+uint16 randint(uint16 range) {
+    if (range == 0) {
+        return 0;
+    }
+    uint32_t r = range;
+    uint64_t m = (uint64_t)(uint32_t)rng() * r;
+    if ((uint32_t)m < r) {
+        uint32_t threshold = -r % r;
+        while ((uint32_t)m < threshold) {
+            m = (uint64_t)(uint32_t)rng() * r;
+        }
+    }
+    return m >> 32;
+}
+
+// the bottom right corner of the current soup
+uint16 ip_bottom = 0;
+uint16 ip_right = 0;
+
+typedef struct engine_info {
+    uint16 x;
+    uint16 y;
+    uint16 phase;
+} engine_info;
+
+engine_info* global_engines;
+
+// the most recent soups, so any of them can be run again
+typedef struct soup_record {
+    uint64 soup;
+    // how many random numbers were used before the soup was made, only for random soups
+    uint64_t rng_position;
+    // the engines in the same form as global_engines, so y is the gap from the previous engine
+    uint16 engine_count;
+    engine_info* engines;
+    uint16 top;
+    uint16 bottom;
+    uint16 left;
+    uint16 right;
+    bool running;
+    uint32 generations;
+} soup_record;
+
+soup_record soup_history[SOUPHISTORY];
+// the record for the soup that's running now
+soup_record* current_soup;
+
+
+
+#if ADAPTIVE > 0
+
+/*
+adaptive sampling for random soups
+each choice (y gap, x offset, engine count) is a multi-armed bandit, every arm is weighted by its average reward (with a prior of 1 reward in 2 soups)
+a fixed part of the time the choice is uniform, so arms that had bad luck early on still get tried
+*/
+
+typedef struct arms {
+    // the value of the first arm
+    uint16 start;
+    uint16 count;
+    double* soups;
+    double* rewards;
+    // cumulative probabilities for sampling
+    double* cdf;
+} arms;
+
+arms gap_arms;
+arms x_arms;
+arms engine_arms;
+
+// the arms used by the current soup
+uint16 soup_engines;
+uint16* soup_gaps;
+uint16* soup_xs;
+double soup_reward;
+uint64_t adaptive_soups = 0;
+
+void init_arms(arms* a, uint16 start, uint16 count) {
+    a->start = start;
+    a->count = count;
+    a->soups = calloc(count, sizeof(double));
+    a->rewards = calloc(count, sizeof(double));
+    a->cdf = malloc(count * sizeof(double));
+}
+
+void free_arms(arms* a) {
+    free(a->soups);
+    free(a->rewards);
+    free(a->cdf);
+}
+
+void update_cdf(arms* a) {
+    double total = 0;
+    for (uint16 i = 0; i < a->count; i++) {
+        total += (a->rewards[i] + 1) / (a->soups[i] + 2);
+    }
+    double sum = 0;
+    for (uint16 i = 0; i < a->count; i++) {
+        sum += ADAPTIVEEXPLORE / a->count + (1 - ADAPTIVEEXPLORE) * (a->rewards[i] + 1) / (a->soups[i] + 2) / total;
+        a->cdf[i] = sum;
+    }
+    a->cdf[a->count - 1] = 1;
+}
+
+// returns the index of a random arm
+uint16 sample_arm(arms* a) {
+    double value = (double)(rng() >> 11) * 0x1.0p-53;
+    uint16 low = 0;
+    uint16 high = a->count - 1;
+    while (low < high) {
+        uint16 mid = (low + high) / 2;
+        if (a->cdf[mid] <= value) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void update_adaptive() {
+    update_cdf(&gap_arms);
+    update_cdf(&x_arms);
+    update_cdf(&engine_arms);
+}
+
+void init_adaptive() {
+    init_arms(&gap_arms, MINY, MAXY - MINY + 1);
+    init_arms(&x_arms, 0, max_x_sep == 0 ? 1 : max_x_sep);
+    // see ADAPTIVE for why this starts at 2
+    uint16 min_engines = engines < 2 ? engines : 2;
+    init_arms(&engine_arms, min_engines, engines - min_engines + 1);
+    soup_gaps = malloc(sizeof(uint16) * engines);
+    soup_xs = malloc(sizeof(uint16) * engines);
+    update_adaptive();
+}
+
+void free_adaptive() {
+    free_arms(&gap_arms);
+    free_arms(&x_arms);
+    free_arms(&engine_arms);
+    free(soup_gaps);
+    free(soup_xs);
+}
+
+void reward_arm(arms* a, uint16 i, double reward) {
+    a->soups[i]++;
+    a->rewards[i] += reward;
+}
+
+void halve_arms(arms* a) {
+    for (uint16 i = 0; i < a->count; i++) {
+        a->soups[i] /= 2;
+        a->rewards[i] /= 2;
+    }
+}
+
+// gives the current soup's arms its reward
+void finish_adaptive_soup() {
+    reward_arm(&engine_arms, soup_engines - engine_arms.start, soup_reward);
+    for (uint16 i = 1; i < soup_engines; i++) {
+        reward_arm(&gap_arms, soup_gaps[i], soup_reward);
+        reward_arm(&x_arms, soup_xs[i], soup_reward);
+    }
+    adaptive_soups++;
+    if (adaptive_soups % ADAPTIVEWINDOW == 0) {
+        halve_arms(&gap_arms);
+        halve_arms(&x_arms);
+        halve_arms(&engine_arms);
+    }
+    if (adaptive_soups % ADAPTIVEUPDATE == 0) {
+        update_adaptive();
+    }
+}
+
+void write_arms(FILE* f, char* name, arms* a) {
+    fprintf(f, " %s %"PRIuFAST16" %"PRIuFAST16, name, a->start, a->count);
+    for (uint16 i = 0; i < a->count; i++) {
+        // the state file gets read back after every write, so these have to round-trip exactly
+        fprintf(f, " %.17g %.17g", a->soups[i], a->rewards[i]);
+    }
+}
+
+// reads arms written by write_arms, arms that aren't in the current ranges are skipped
+char* read_arms(char* str, arms* a) {
+    char* end;
+    uint16 start = strtoul(str, &end, 10);
+    uint16 count = strtoul(end, &end, 10);
+    for (uint16 i = 0; i < count; i++) {
+        double soups = strtod(end, &end);
+        double rewards = strtod(end, &end);
+        if (start + i >= a->start && start + i < a->start + a->count) {
+            a->soups[start + i - a->start] = soups;
+            a->rewards[start + i - a->start] = rewards;
+        }
+    }
+    return end;
+}
+
+// parses the adaptive line of the state file (without the "adaptive" at the start)
+void read_adaptive(char* str) {
+    char name[16];
+    int length;
+    while (sscanf(str, " %15s%n", name, &length) == 1) {
+        str += length;
+        if (strcmp(name, "gaps") == 0) {
+            str = read_arms(str, &gap_arms);
+        } else if (strcmp(name, "xs") == 0) {
+            str = read_arms(str, &x_arms);
+        } else if (strcmp(name, "engines") == 0) {
+            str = read_arms(str, &engine_arms);
+        } else {
+            break;
+        }
+    }
+    update_adaptive();
+}
+
+#endif
+
+// puts an engine phase in data at (x, y), cells in its box that are already there get overwritten like the rest of the box
+static inline void stamp_engine(uint16 phase_index, uint16 x, uint16 y) {
+    engine_stamp* stamp = &engine_stamps[phase_index][x & 7];
+    uint8_t* row = data + ((uint32)y << WIDTH) + (x & ~7);
+    uint64_t* bits = stamp->bits;
+    uint64_t* mask = stamp->mask;
+    for (uint16 cy = 0; cy < stamp->height; cy++) {
+        for (uint16 w = 0; w < stamp->words; w++) {
+            uint64_t word;
+            memcpy(&word, row + w * 8, 8);
+            word = (word & ~*mask) | *bits;
+            memcpy(row + w * 8, &word, 8);
+            bits++;
+            mask++;
+        }
+        row += WIDTHVALUE;
+    }
+}
+
+// picks the engines for the next soup (in current_soup) and stamps them into data
+void create_soup() {
+    clear();
+    uint16 y;
+    uint16 x;
+    engine_phase* phase;
+    top = STARTY;
+    bottom = 0;
+    left = STARTX;
+    right = 0;
+    // clock_t start = clock();
+    if (use_random_soups) {
+        x = STARTX;
+        y = STARTY;
+        uint16 prev_y = STARTY;
+        uint16 soup_engine_count = engines;
+        #if ADAPTIVE > 0
+        soup_engines = engine_arms.start + sample_arm(&engine_arms);
+        soup_engine_count = soup_engines;
+        soup_reward = 0;
+        #endif
+        for (uint16 i = 0; i < soup_engine_count; i++) {
+            uint16 phase_index = randint(ENGINEPHASES);
+            phase = engine_phases[phase_index];
+            // idk why this is needed, someone should figure out why because this probably slows it down
+            if (phase == NULL) {
+                generate_phases();
+                create_soup();
+                return;
+            }
+            current_soup->engines[i].x = x - STARTX;
+            current_soup->engines[i].y = y - prev_y;
+            current_soup->engines[i].phase = phase_index;
+            prev_y = y;
+            if (x + phase->width > right) {
+                right = x + phase->width;
+            }
+            if (y + phase->height > bottom) {
+                bottom = y + phase->height;
+            }
+            #if ADAPTIVE > 0
+            if (i + 1 < soup_engine_count) {
+                soup_xs[i + 1] = sample_arm(&x_arms);
+                soup_gaps[i + 1] = sample_arm(&gap_arms);
+                x = STARTX + x_arms.start + soup_xs[i + 1];
+                y += gap_arms.start + soup_gaps[i + 1];
+            }
+            #else
+            x = STARTX + randint(max_x_sep);
+            y += MINY + randint(MAXY - MINY + 1);
+            #endif
+        }
+        current_soup->engine_count = soup_engine_count;
+    } else {
+        y = STARTY;
+        for (uint16 i = 0; i < engines; i++) {
+            engine_info engine = global_engines[i];
+            current_soup->engines[i] = engine;
+            y += engine.y;
+            phase = engine_phases[engine.phase];
+            if (STARTX + engine.x + phase->width > right) {
+                right = STARTX + engine.x + phase->width;
+            }
+            if (y + phase->height > bottom) {
+                bottom = y + phase->height;
+            }
+        }
+        current_soup->engine_count = engines;
+        // go to the next soup, the last engine changes the fastest
+        for (int32_t i = engines - 1; i >= 0; i--) {
+            engine_info* engine = &global_engines[i];
+            if (i > 0) {
+                if (engine->y != MAXY) {
+                    engine->y++;
+                    break;
+                }
+                engine->y = MINY;
+                if (engine->x != max_x_sep) {
+                    engine->x++;
+                    break;
+                }
+                engine->x = 0;
+            }
+            engine->phase = (engine->phase + 1) % ENGINEPHASES;
+            if (engine->phase != 0) {
+                break;
+            }
+        }
+    }
+    #if STATES > 2
+    // data only gets updated when phases are cached, so there can be old cells in the box that clear missed
+    for (uint16 cy = top; cy < bottom; cy++) {
+        memset(data + ((uint32)cy << WIDTH) + left, 0, right - left);
+    }
+    #endif
+    y = STARTY;
+    for (uint16 i = 0; i < current_soup->engine_count; i++) {
+        engine_info engine = current_soup->engines[i];
+        y += engine.y;
+        if (TRACING(2)) {
+            printf("Placing phase %"PRIuFAST16" at x = %"PRIuFAST16", y = %"PRIuFAST16"\n", engine.phase, STARTX + engine.x, y);
+        }
+        stamp_engine(engine.phase, STARTX + engine.x, y);
+    }
+    ip_bottom = bottom;
+    ip_right = right;
+    // printf("Generated soup in %.3f seconds\n", ((double)clock() - (double)start) / CLOCKS_PER_SEC);
+}
+
+// draws the current soup into cells, which is (ip_right - STARTX) wide
+void render_soup(uint8_t* cells) {
+    uint16 width = ip_right - STARTX;
+    memset(cells, 0, (uint32)(ip_bottom - STARTY) * width);
+    uint16 y = 0;
+    for (uint16 i = 0; i < current_soup->engine_count; i++) {
+        engine_info engine = current_soup->engines[i];
+        engine_phase* phase = engine_phases[engine.phase];
+        y += engine.y;
+        for (uint16 cy = 0; cy < phase->height; cy++) {
+            memcpy(cells + (uint32)(y + cy) * width + engine.x, phase->data + cy * phase->width, phase->width);
+        }
+    }
+}
+
+
+
+typedef struct pattern_data {
+    uint16 top;
+    uint16 left;
+    uint16 height;
+    uint16 width;
+    uint32 size;
+    uint32 length;
+    uint32 population;
+    uint64_t hash;
+    uint32_t data[];
+} pattern_data;
+
+// bits used for each cell in pattern_data, dying cells need their own values so there can be at most 4 states
+#if STATES > 2
+#define CELLBITS 2
+#else
+#define CELLBITS 1
+#endif
+#define WORDCELLS (32 / CELLBITS)
+
+THREADLOCAL uint32 phase_number;
+THREADLOCAL uint32 cached_phases;
+THREADLOCAL pattern_data** phase_cache;
+
+// the rows of the pattern being packed, one after another, so it can be packed a whole word at a time
+THREADLOCAL uint8_t pack_buffer[SIZEVALUE + WORDCELLS];
+
+// packs the cells, population and hash into out, this gets compiled for each instruction set
+static inline ALWAYSINLINE void pack_pattern_kernel(pattern_data* out, uint8_t* grid, uint16 shift, uint16 top, uint16 bottom, uint16 left, uint16 right) {
+    uint16 width = right - left;
+    uint8_t* buffer = pack_buffer;
+    for (uint16 y = top; y < bottom; y++) {
+        memcpy(buffer, grid + ((uint32)y << shift) + left, width);
+        buffer += width;
+    }
+    // the end of the last word is dead cells
+    memset(buffer, 0, WORDCELLS);
+    uint32 population = 0;
+    for (uint32 i = 0; i < out->length; i++) {
+        uint8_t* cells = pack_buffer + i * WORDCELLS;
+        uint32_t word = 0;
+        for (uint16 j = 0; j < WORDCELLS; j++) {
+            word |= (uint32_t)cells[j] << (j * CELLBITS);
+            population += cells[j] != 0;
+        }
+        out->data[i] = word;
+    }
+    uint32 data_length = out->length;
+    uint64_t hash = 0;
+    for (uint32 i = 0; i < data_length; i += 4) {
+        hash += (uint64_t)out->data[i] << 32;
+        if (data_length - i > 4) {
+            hash += (uint64_t)out->data[i + 1];
+            hash ^= (uint64_t)out->data[i + 2] << 32;
+            hash ^= (uint64_t)out->data[i + 3];
+        } else if (i + 1 < data_length) {
+            hash += (uint64_t)out->data[i + 1];
+            if (i + 2 < data_length) {
+                hash ^= (uint64_t)out->data[i + 2] << 32;
+                if (i + 3 < data_length) {
+                    hash ^= (uint64_t)out->data[i + 3];
+                }
+            }
+        }
+        hash = (hash << 16) | (hash >> 48);
+    }
+    out->hash = hash;
+    out->population = population;
+}
+
+void (*pack_pattern)(pattern_data* out, uint8_t* grid, uint16 shift, uint16 top, uint16 bottom, uint16 left, uint16 right);
+
+// packs a pattern into the phase cache, grid has rows that are (1 << shift) cells long
+// the offsets are added to the stored position, so patterns from different grids can be compared
+void cache_phase_from(uint8_t* grid, uint16 shift, uint16 top, uint16 bottom, uint16 left, uint16 right, int32_t y_offset, int32_t x_offset) {
+    uint16 height = bottom - top;
+    uint16 width = right - left;
+    uint32 size = height * width;
+    uint32 data_length = (size + WORDCELLS - 1) / WORDCELLS;
+    if (data_length == 0) {
+        data_length = 1;
+    }
+    pattern_data* out = malloc(sizeof(pattern_data) + data_length * sizeof(uint32_t));
+    out->top = top + y_offset;
+    out->left = left + x_offset;
+    out->height = height;
+    out->width = width;
+    out->size = size;
+    out->length = data_length;
+    pack_pattern(out, grid, shift, top, bottom, left, right);
+    phase_cache[phase_number] = out;
+    cached_phases = phase_number + 1;
+}
+
+void cache_phase() {
+    cache_phase_from(data, WIDTH, top, bottom, left, right, 0, 0);
+}
+
+#if PREFILTERGENS > 0
+
+#define PFHEIGHTVALUE (1 << PREFILTERHEIGHT)
+#define PFWIDTHVALUE (1 << PREFILTERWIDTH)
+#define PFSIZEVALUE (1 << (PREFILTERHEIGHT + PREFILTERWIDTH))
+
+// the last 3 generations, so period 2 can be detected
+uint8_t pf_data[3][PFSIZEVALUE] = {0};
+uint16 pf_top[3] = {0};
+uint16 pf_bottom[3] = {0};
+uint16 pf_left[3] = {0};
+uint16 pf_right[3] = {0};
+
+void pf_clear(uint16 b) {
+    for (uint16 y = pf_top[b]; y < pf_bottom[b]; y++) {
+        memset(pf_data[b] + ((uint32)y << PREFILTERWIDTH) + pf_left[b], 0, pf_right[b] - pf_left[b]);
+    }
+    pf_top[b] = 0;
+    pf_bottom[b] = 0;
+    pf_left[b] = 0;
+    pf_right[b] = 0;
+}
+
+// same as run_row but without a branch for every cell, the bounding box is found afterwards
+static inline bool pf_run_row(uint8_t* src, uint8_t* dst, uint32 i, uint16 x, uint16 width, uint16* lowX, uint16* highX) {
+    uint16 tr = 0;
+    tr |= (uint16)src[i - PFWIDTHVALUE - 1] << 5;
+    tr |= (uint16)src[i - 1] << 4;
+    tr |= (uint16)src[i + PFWIDTHVALUE - 1] << 3;
+    tr |= (uint16)src[i - PFWIDTHVALUE] << 2;
+    tr |= (uint16)src[i] << 1;
+    tr |= (uint16)src[i + PFWIDTHVALUE];
+    uint8_t any_changed = 0;
+    for (uint32 j = i; j <= i + width; j++) {
+        tr = (tr << 3) & 511;
+        tr |= (uint16)src[j - PFWIDTHVALUE + 1] << 2;
+        tr |= (uint16)src[j + 1] << 1;
+        tr |= (uint16)src[j + PFWIDTHVALUE + 1];
+        dst[j] = transitions[tr];
+        any_changed |= dst[j];
+    }
+    if (!any_changed) {
+        return false;
+    }
+    // only the cells outside the bounding box so far need to be looked at
+    uint16 low = 0;
+    while (x + low < *lowX && !dst[i + low]) {
+        low++;
+    }
+    if (x + low < *lowX) {
+        *lowX = x + low;
+    }
+    uint16 high = width;
+    while (x + high > *highX && !dst[i + high]) {
+        high--;
+    }
+    if (x + high > *highX) {
+        *highX = x + high;
+    }
+    return true;
+}
+
+// whether the newest generation in the prefilter window is the same as the one from 2 generations ago
+static inline bool pf_repeated(uint16 cur) {
+    uint16 old = cur == 2 ? 0 : cur + 1;
+    if (pf_top[old] != pf_top[cur] || pf_bottom[old] != pf_bottom[cur] || pf_left[old] != pf_left[cur] || pf_right[old] != pf_right[cur]) {
+        return false;
+    }
+    for (uint16 y = pf_top[cur]; y < pf_bottom[cur]; y++) {
+        uint32 i = ((uint32)y << PREFILTERWIDTH) + pf_left[cur];
+        if (memcmp(pf_data[cur] + i, pf_data[old] + i, pf_right[cur] - pf_left[cur]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// runs the soup in the prefilter window, caching phases like the full simulation but without checking them
+// returns false if the soup can be thrown out, and sets end_gen to the generation it stopped at
+// otherwise end_gen is the generation the full simulation should continue from (the pattern in data is updated to that generation)
+// this only throws out soups that the full simulation would throw out too
+bool prefilter(uint32* end_gen) {
+    uint16 height = bottom - top;
+    uint16 width = right - left;
+    *end_gen = 0;
+    if (height + 8 > PFHEIGHTVALUE || width + 8 > PFWIDTHVALUE) {
+        return true;
+    }
+    for (uint16 b = 0; b < 3; b++) {
+        pf_clear(b);
+    }
+    uint16 cur = 0;
+    uint16 start_y = (PFHEIGHTVALUE - height) / 2;
+    uint16 start_x = (PFWIDTHVALUE - width) / 2;
+    pf_top[0] = start_y;
+    pf_bottom[0] = start_y + height;
+    pf_left[0] = start_x;
+    pf_right[0] = start_x + width;
+    for (uint16 y = 0; y < height; y++) {
+        memcpy(pf_data[0] + ((uint32)(start_y + y) << PREFILTERWIDTH) + start_x, data + ((uint32)(top + y) << WIDTH) + left, width);
+    }
+    // window coordinates plus these are grid coordinates
+    int32_t y_offset = (int32_t)top - start_y;
+    int32_t x_offset = (int32_t)left - start_x;
+    uint32 gen;
+    for (gen = 0; gen < PREFILTERGENS && gen < max_period; gen++) {
+        if (pf_top[cur] + y_offset < 2 || pf_bottom[cur] + y_offset > HEIGHTVALUE - 2 || pf_left[cur] + x_offset < 2 || pf_right[cur] + x_offset > WIDTHVALUE - 2) {
+            // the full simulation would stop here, so let it do that
+            goto restart;
+        }
+        if (pf_top[cur] < 2 || pf_bottom[cur] > PFHEIGHTVALUE - 2 || pf_left[cur] < 2 || pf_right[cur] > PFWIDTHVALUE - 2) {
+            // it got out of the window, so it can't be judged here
+            break;
+        }
+        uint16 next = cur == 2 ? 0 : cur + 1;
+        pf_clear(next);
+        uint16 lowX = PFWIDTHVALUE;
+        uint16 highX = 0;
+        uint16 lowY = PFHEIGHTVALUE;
+        uint16 highY = 0;
+        uint16 row_width = pf_right[cur] - pf_left[cur] + 1;
+        uint32 i = ((uint32)(pf_top[cur] - 1) << PREFILTERWIDTH) + pf_left[cur] - 1;
+        for (uint16 y = pf_top[cur] - 1; y <= pf_bottom[cur]; y++) {
+            if (pf_run_row(pf_data[cur], pf_data[next], i, pf_left[cur] - 1, row_width, &lowX, &highX)) {
+                if (y < lowY) {
+                    lowY = y;
+                }
+                if (y > highY) {
+                    highY = y;
+                }
+            }
+            i += PFWIDTHVALUE;
+        }
+        cur = next;
+        if (lowX <= highX) {
+            pf_top[cur] = lowY;
+            pf_bottom[cur] = highY + 1;
+            pf_left[cur] = lowX;
+            pf_right[cur] = highX + 1;
+        }
+        if (!(lowX < highX)) {
+            // same check as run_generation
+            *end_gen = gen;
+            return false;
+        }
+        #if SKIPOSCILLATORS > 0
+        // a still life or period 2 oscillator can't have had a ship in it earlier either
+        if (gen > 0 && pf_repeated(cur)) {
+            *end_gen = gen;
+            return false;
+        }
+        #endif
+        if (gen % check_interval == 0) {
+            cache_phase_from(pf_data[cur], PREFILTERWIDTH, pf_top[cur], pf_bottom[cur], pf_left[cur], pf_right[cur], y_offset, x_offset);
+            phase_number++;
+        }
+    }
+    // put it back in the full grid
+    if (pf_top[cur] + y_offset < 2 || pf_bottom[cur] + y_offset > HEIGHTVALUE - 2 || pf_left[cur] + x_offset < 2 || pf_right[cur] + x_offset > WIDTHVALUE - 2) {
+        goto restart;
+    }
+    clear();
+    top = pf_top[cur] + y_offset;
+    bottom = pf_bottom[cur] + y_offset;
+    left = pf_left[cur] + x_offset;
+    right = pf_right[cur] + x_offset;
+    for (uint16 y = 0; y < bottom - top; y++) {
+        memcpy(data + ((uint32)(top + y) << WIDTH) + left, pf_data[cur] + ((uint32)(pf_top[cur] + y) << PREFILTERWIDTH) + pf_left[cur], right - left);
+    }
+    *end_gen = gen;
+    return true;
+    restart:;
+    for (uint32 i = 0; i < cached_phases; i++) {
+        free(phase_cache[i]);
+    }
+    phase_number = 0;
+    cached_phases = 0;
+    return true;
+}
+
+#endif
+
+
+#if REDUCEPERIOD > 0
+uint32 gcd(uint32 a, uint32 b) {
+    while (b != 0) {
+        uint32 temp = b;
+        b = a % b;
+        a = temp;
+    }
+    return a;
+}
+#endif
+
+// speeds are stored as (period << 32) | (dy << 16) | dx
+uint64_t make_speed(int64_t dx, int64_t dy, uint32 period) {
+    if (dx < 0) {
+        dx = -dx;
+    }
+    if (dy < 0) {
+        dy = -dy;
+    }
+    if (dx == 0 && dy == 0) {
+        return (uint64_t)period << 32;
+    }
+    // the rules are isotropic, so every ship is stored as if it's going east (and south if it's not orthogonal)
+    if (dy > dx) {
+        int64_t temp = dx;
+        dx = dy;
+        dy = temp;
+    }
+    #if REDUCEPERIOD > 0
+    uint32 num = gcd(gcd(dx, dy), period);
+    dx /= num;
+    dy /= num;
+    period /= num;
+    #endif
+    if (dx > 65535) {
+        return 0;
+    }
+    return ((uint64_t)period << 32) | ((uint64_t)dy << 16) | (uint64_t)dx;
+}
+
+// returns the speed if the pattern is periodic, and 0 otherwise
+// compares packed patterns, this gets compiled for each instruction set
+static inline ALWAYSINLINE bool same_data_kernel(uint32_t* a, uint32_t* b, uint32 length) {
+    uint32_t diff = 0;
+    for (uint32 i = 0; i < length; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+bool (*same_data)(uint32_t* a, uint32_t* b, uint32 length);
+
+// whether two cached phases are the same pattern (possibly in different places)
+bool same_phase(pattern_data* a, pattern_data* b) {
+    return a->hash == b->hash && a->population == b->population && a->height == b->height && a->width == b->width && same_data(a->data, b->data, a->length);
+}
+
+// returns the newest earlier phase that's the same as the current one, or UINT_FAST32_MAX if there isn't one
+uint32 find_matching_phase() {
+    pattern_data* current = phase_cache[phase_number];
+    for (uint32 i = phase_number - 1; i < UINT_FAST32_MAX; i--) {
+        // printf("Checking generation %"PRIuFAST16" %"PRIuFAST32" %"PRIuFAST32"\n", i, current->population, phase_cache[i]->population);
+        if (same_phase(current, phase_cache[i])) {
+            return i;
+        }
+    }
+    return UINT_FAST32_MAX;
+}
+
+uint64_t check_for_spaceship() {
+    uint32 i = find_matching_phase();
+    if (i == UINT_FAST32_MAX) {
+        return 0;
+    }
+    pattern_data* current = phase_cache[phase_number];
+    pattern_data* data = phase_cache[i];
+    uint32 period = (phase_number - i) * check_interval;
+    return make_speed((int64_t)current->left - (int64_t)data->left, (int64_t)current->top - (int64_t)data->top, period);
+}
+
+
+/*
+cpu feature dispatch
+the kernels above are compiled for each instruction set, and the best one that the cpu supports is picked at startup with cpuid
+this way one binary is fast everywhere without needing -march=native
+*/
+
+#define KERNEL_SCALAR 0
+#define KERNEL_SSE2 1
+#define KERNEL_AVX2 2
+#define KERNEL_AVX512 3
+#define KERNEL_TYPES 4
+
+const char* kernel_names[KERNEL_TYPES] = {"scalar", "sse2", "avx2", "avx512"};
+
+#if BANDTHREADS > 1 && !defined(BRUH)
+#define BANDKERNEL(name, attributes, split) \
+    attributes void run_band_##name(band* b) { \
+        run_band_kernel(b, split); \
+    }
+#else
+#define BANDKERNEL(name, attributes, split)
+#endif
+
+// split is whether rows are run with the split loops (see run_row)
+#define KERNELS(name, attributes, split) \
+    attributes bool run_generation_##name() { \
+        return run_generation_kernel(split); \
+    } \
+    attributes void pack_pattern_##name(pattern_data* out, uint8_t* grid, uint16 shift, uint16 top, uint16 bottom, uint16 left, uint16 right) { \
+        pack_pattern_kernel(out, grid, shift, top, bottom, left, right); \
+    } \
+    attributes bool same_data_##name(uint32_t* a, uint32_t* b, uint32 length) { \
+        return same_data_kernel(a, b, length); \
+    } \
+    attributes void fill_rng_##name() { \
+        fill_rng_kernel(); \
+    } \
+    BANDKERNEL(name, attributes, split)
+
+#ifdef X86KERNELS
+// the scalar kernels are the sse2 ones without autovectorization, since sse2 is always there on x86-64
+// clang doesn't have a way to turn that off for one function, so there they're the same as the sse2 ones
+#ifdef __clang__
+KERNELS(scalar, , false)
+#else
+KERNELS(scalar, __attribute__((optimize("no-tree-vectorize"))), false)
+#endif
+KERNELS(sse2, __attribute__((target("sse2"))), false)
+KERNELS(avx2, __attribute__((target("avx2,bmi,bmi2,lzcnt,popcnt"))), true)
+KERNELS(avx512, __attribute__((target("avx512f,avx512bw,avx512vl,avx2,bmi,bmi2,lzcnt,popcnt"))), true)
+#else
+KERNELS(scalar, , false)
+#endif
+
+uint16 kernel_type;
+
+#ifdef X86KERNELS
+// the avx2 and avx512 kernels are also built with these, which aren't part of avx2
+static inline bool bit_ops_supported() {
+    return __builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("lzcnt") && __builtin_cpu_supports("popcnt");
+}
+#endif
+
+bool kernel_supported(uint16 type) {
+    #ifdef X86KERNELS
+    __builtin_cpu_init();
+    switch (type) {
+        case KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2") && bit_ops_supported();
+        case KERNEL_AVX512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx2") && bit_ops_supported();
+    }
+    #endif
+    return type == KERNEL_SCALAR;
+}
+
+// picks the kernels, forced is the kernel type from -k or -1 to use the best one the cpu supports
+void init_kernels(int32_t forced) {
+    if (forced >= 0) {
+        if (!kernel_supported(forced)) {
+            printf("This CPU doesn't support the %s kernels\n", kernel_names[forced]);
+            exit(1);
+        }
+        kernel_type = forced;
+    } else {
+        kernel_type = KERNEL_SCALAR;
+        for (uint16 i = 1; i < KERNEL_TYPES; i++) {
+            if (kernel_supported(i)) {
+                kernel_type = i;
+            }
+        }
+    }
+    switch (kernel_type) {
+        #ifdef X86KERNELS
+        case KERNEL_SSE2:
+            run_generation = run_generation_sse2;
+            pack_pattern = pack_pattern_sse2;
+            same_data = same_data_sse2;
+            fill_rng = fill_rng_sse2;
+            #if BANDTHREADS > 1 && !defined(BRUH)
+            run_band = run_band_sse2;
+            #endif
+            break;
+        case KERNEL_AVX2:
+            run_generation = run_generation_avx2;
+            pack_pattern = pack_pattern_avx2;
+            same_data = same_data_avx2;
+            fill_rng = fill_rng_avx2;
+            #if BANDTHREADS > 1 && !defined(BRUH)
+            run_band = run_band_avx2;
+            #endif
+            break;
+        case KERNEL_AVX512:
+            run_generation = run_generation_avx512;
+            pack_pattern = pack_pattern_avx512;
+            same_data = same_data_avx512;
+            fill_rng = fill_rng_avx512;
+            #if BANDTHREADS > 1 && !defined(BRUH)
+            run_band = run_band_avx512;
+            #endif
+            break;
+        #endif
+        default:
+            run_generation = run_generation_scalar;
+            pack_pattern = pack_pattern_scalar;
+            same_data = same_data_scalar;
+            fill_rng = fill_rng_scalar;
+            #if BANDTHREADS > 1 && !defined(BRUH)
+            run_band = run_band_scalar;
+            #endif
+    }
+}
+
+
+#if HASHLIFE > 0
+
+/*
+hashlife backend for soups that outlast max-period
+the pattern is stored as a canonicalized quadtree (every distinct node exists exactly once), and the result of running a node forward is memoized in the node, using the same transition table as the normal simulation
+period detection uses brent's algorithm on steps of 2^HASHLIFESTEP generations, which stay cheap because the memoized results get reused every time the ship lines up with the quadtree again
+the tortoise is 2^HASHLIFESTEP generations in a row, so every period shows up as the difference between one of them and a step, and that gets cut down to the real period afterwards
+when the nodes run out the ones that aren't used by the patterns being kept are freed, and the step is tried again
+*/
+
+typedef struct node {
+    struct node* nw;
+    struct node* ne;
+    struct node* sw;
+    struct node* se;
+    // the center of this node after 2^result_step generations
+    struct node* result;
+    // next node in the same hash table bucket
+    struct node* next;
+    uint64_t population;
+    uint16 level;
+    uint16 result_step;
+    // used by the garbage collector
+    bool marked;
+} node;
+
+node dead_leaf = {0};
+node alive_leaf = {.population = 1};
+
+// these are per thread since the minimize threads use hashlife for the ships it found, the pool gets allocated the first time a thread needs it
+THREADLOCAL node* node_pool = NULL;
+// nodes in node_pool that have ever been used, freed ones are in free_nodes
+THREADLOCAL uint32 nodes_used;
+THREADLOCAL uint32 live_nodes;
+THREADLOCAL node* free_nodes;
+THREADLOCAL node** node_table = NULL;
+THREADLOCAL node* empty_nodes[64];
+THREADLOCAL jmp_buf hashlife_abort;
+
+THREADLOCAL node* root;
+THREADLOCAL int64_t root_x;
+THREADLOCAL int64_t root_y;
+
+static inline uint32 node_bucket(node* nw, node* ne, node* sw, node* se) {
+    uint64_t hash = (uintptr_t)nw * 0x9E3779B97F4A7C15;
+    hash = (hash ^ (uintptr_t)ne) * 0xBF58476D1CE4E5B9;
+    hash = (hash ^ (uintptr_t)sw) * 0x94D049BB133111EB;
+    hash = (hash ^ (uintptr_t)se) * 0x9E3779B97F4A7C15;
+    return (hash >> 32) % HASHLIFEMAXNODES;
+}
+
+// empties the hash table, only the buckets that nodes went in are cleared since most soups only use a few of them
+void clear_node_table() {
+    for (uint32 i = 0; i < nodes_used; i++) {
+        node* n = &node_pool[i];
+        node_table[node_bucket(n->nw, n->ne, n->sw, n->se)] = NULL;
+    }
+}
+
+void hashlife_reset() {
+    if (node_pool == NULL) {
+        node_pool = malloc(HASHLIFEMAXNODES * sizeof(node));
+        node_table = malloc(HASHLIFEMAXNODES * sizeof(node*));
+        memset(node_table, 0, HASHLIFEMAXNODES * sizeof(node*));
+        nodes_used = 0;
+    }
+    clear_node_table();
+    nodes_used = 0;
+    live_nodes = 0;
+    free_nodes = NULL;
+    for (uint16 i = 0; i < 64; i++) {
+        empty_nodes[i] = NULL;
+    }
+    empty_nodes[0] = &dead_leaf;
+}
+
+node* find_node(node* nw, node* ne, node* sw, node* se) {
+    uint32 bucket = node_bucket(nw, ne, sw, se);
+    for (node* n = node_table[bucket]; n != NULL; n = n->next) {
+        if (n->nw == nw && n->ne == ne && n->sw == sw && n->se == se) {
+            return n;
+        }
+    }
+    node* out;
+    if (free_nodes != NULL) {
+        out = free_nodes;
+        free_nodes = out->next;
+    } else if (nodes_used < HASHLIFEMAXNODES) {
+        out = &node_pool[nodes_used];
+        nodes_used++;
+    } else {
+        longjmp(hashlife_abort, 1);
+    }
+    live_nodes++;
+    out->marked = false;
+    out->nw = nw;
+    out->ne = ne;
+    out->sw = sw;
+    out->se = se;
+    out->result = NULL;
+    out->population = nw->population + ne->population + sw->population + se->population;
+    out->level = nw->level + 1;
+    out->next = node_table[bucket];
+    node_table[bucket] = out;
+    return out;
+}
+
+node* empty_node(uint16 level) {
+    if (empty_nodes[level] == NULL) {
+        node* sub = empty_node(level - 1);
+        empty_nodes[level] = find_node(sub, sub, sub, sub);
+    }
+    return empty_nodes[level];
+}
+
+static inline node* centre(node* n) {
+    return find_node(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw);
+}
+
+// runs a level 2 node (4x4) for 1 generation with the transition table
+node* run_base(node* n) {
+    uint16 cells = 0;
+    node* quads[4] = {n->nw, n->ne, n->sw, n->se};
+    for (uint16 q = 0; q < 4; q++) {
+        uint16 shift = (q >> 1) * 8 + (q & 1) * 2;
+        cells |= quads[q]->nw->population << shift;
+        cells |= quads[q]->ne->population << (shift + 1);
+        cells |= quads[q]->sw->population << (shift + 4);
+        cells |= quads[q]->se->population << (shift + 5);
+    }
+    node* out[4];
+    for (uint16 i = 0; i < 4; i++) {
+        uint16 x = (i & 1) + 1;
+        uint16 y = (i >> 1) + 1;
+        uint16 tr = 0;
+        for (uint16 cx = x - 1; cx <= x + 1; cx++) {
+            for (uint16 cy = y - 1; cy <= y + 1; cy++) {
+                tr = (tr << 1) | ((cells >> (cy * 4 + cx)) & 1);
+            }
+        }
+        out[i] = transitions[tr] ? &alive_leaf : &dead_leaf;
+    }
+    return find_node(out[0], out[1], out[2], out[3]);
+}
+
+// returns the center of the node after 2^step generations, step must be at most level - 2
+node* run_node(node* n, uint16 step) {
+    if (n->population == 0) {
+        return n->nw;
+    }
+    if (n->result != NULL && n->result_step == step) {
+        return n->result;
+    }
+    node* out;
+    if (n->level == 2) {
+        out = run_base(n);
+    } else {
+        node* c[9] = {
+            n->nw,
+            find_node(n->nw->ne, n->ne->nw, n->nw->se, n->ne->sw),
+            n->ne,
+            find_node(n->nw->sw, n->nw->se, n->sw->nw, n->sw->ne),
+            find_node(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw),
+            find_node(n->ne->sw, n->ne->se, n->se->nw, n->se->ne),
+            n->sw,
+            find_node(n->sw->ne, n->se->nw, n->sw->se, n->se->sw),
+            n->se,
+        };
+        // the first half of the generations
+        uint16 sub_step = step < n->level - 3 ? step : n->level - 3;
+        for (uint16 i = 0; i < 9; i++) {
+            c[i] = run_node(c[i], sub_step);
+        }
+        node* q[4] = {
+            find_node(c[0], c[1], c[3], c[4]),
+            find_node(c[1], c[2], c[4], c[5]),
+            find_node(c[3], c[4], c[6], c[7]),
+            find_node(c[4], c[5], c[7], c[8]),
+        };
+        if (step == n->level - 2) {
+            // the second half of the generations
+            out = find_node(run_node(q[0], sub_step), run_node(q[1], sub_step), run_node(q[2], sub_step), run_node(q[3], sub_step));
+        } else {
+            out = find_node(centre(q[0]), centre(q[1]), centre(q[2]), centre(q[3]));
+        }
+    }
+    n->result = out;
+    n->result_step = step;
+    return out;
+}
+
+// whether everything alive is in the middle half of the root
+static inline bool root_centred() {
+    return root->population == root->nw->se->population + root->ne->sw->population + root->sw->ne->population + root->se->nw->population;
+}
+
+void expand_root() {
+    node* e = empty_node(root->level - 1);
+    int64_t offset = (int64_t)1 << (root->level - 1);
+    root = find_node(find_node(e, e, e, root->nw), find_node(e, e, root->ne, e), find_node(e, root->sw, e, e), find_node(root->se, e, e, e));
+    root_x -= offset;
+    root_y -= offset;
+}
+
+// runs the whole pattern for 2^step generations
+void hashlife_step(uint16 step) {
+    while (root->level > step + 3 && root_centred()) {
+        int64_t offset = (int64_t)1 << (root->level - 2);
+        root = centre(root);
+        root_x += offset;
+        root_y += offset;
+    }
+    while (root->level < step + 2 || !root_centred()) {
+        expand_root();
+    }
+    // everything can move 2^step cells outwards, so it needs one more level of padding
+    expand_root();
+    int64_t offset = (int64_t)1 << (root->level - 2);
+    root = run_node(root, step);
+    root_x += offset;
+    root_y += offset;
+}
+
+node* build_node(uint16 level, int64_t x, int64_t y) {
+    int64_t size = (int64_t)1 << level;
+    if (x >= right || y >= bottom || x + size <= left || y + size <= top) {
+        return empty_node(level);
+    }
+    if (level == 0) {
+        return data[((uint32)y << WIDTH) + x] ? &alive_leaf : &dead_leaf;
+    }
+    int64_t half = size >> 1;
+    return find_node(build_node(level - 1, x, y), build_node(level - 1, x + half, y), build_node(level - 1, x, y + half), build_node(level - 1, x + half, y + half));
+}
+
+bool get_cell(node* n, int64_t x, int64_t y) {
+    while (n->level > 0) {
+        if (n->population == 0) {
+            return false;
+        }
+        int64_t half = (int64_t)1 << (n->level - 1);
+        if (y < half) {
+            n = x < half ? n->nw : n->ne;
+        } else {
+            n = x < half ? n->sw : n->se;
+            y -= half;
+        }
+        if (x >= half) {
+            x -= half;
+        }
+    }
+    return n->population != 0;
+}
+
+typedef struct hashlife_state {
+    node* root;
+    int64_t x;
+    int64_t y;
+    // bounding box, relative to x and y
+    int64_t top;
+    int64_t left;
+    int64_t bottom;
+    int64_t right;
+} hashlife_state;
+
+void find_bounds(node* n, int64_t x, int64_t y, hashlife_state* state) {
+    if (n->population == 0) {
+        return;
+    }
+    int64_t size = (int64_t)1 << n->level;
+    // skip nodes that can't change the bounding box
+    if (x >= state->left && y >= state->top && x + size <= state->right && y + size <= state->bottom) {
+        return;
+    }
+    if (n->level == 0) {
+        if (x < state->left) {
+            state->left = x;
+        }
+        if (y < state->top) {
+            state->top = y;
+        }
+        if (x + 1 > state->right) {
+            state->right = x + 1;
+        }
+        if (y + 1 > state->bottom) {
+            state->bottom = y + 1;
+        }
+        return;
+    }
+    int64_t half = size >> 1;
+    find_bounds(n->nw, x, y, state);
+    find_bounds(n->ne, x + half, y, state);
+    find_bounds(n->sw, x, y + half, state);
+    find_bounds(n->se, x + half, y + half, state);
+}
+
+void save_state(hashlife_state* state) {
+    state->root = root;
+    state->x = root_x;
+    state->y = root_y;
+    state->top = INT64_MAX;
+    state->left = INT64_MAX;
+    state->bottom = INT64_MIN;
+    state->right = INT64_MIN;
+    find_bounds(root, 0, 0, state);
+}
+
+// whether the two patterns are the same apart from their position
+bool same_pattern(hashlife_state* a, hashlife_state* b) {
+    if (a->root->population != b->root->population) {
+        return false;
+    }
+    if (a->bottom - a->top != b->bottom - b->top || a->right - a->left != b->right - b->left) {
+        return false;
+    }
+    for (int64_t y = 0; y < a->bottom - a->top; y++) {
+        for (int64_t x = 0; x < a->right - a->left; x++) {
+            if (get_cell(a->root, a->left + x, a->top + y) != get_cell(b->root, b->left + x, b->top + y)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+#define TORTOISEPHASES (1 << HASHLIFESTEP)
+
+// the patterns the period search is comparing
+THREADLOCAL hashlife_state tortoise[TORTOISEPHASES];
+THREADLOCAL hashlife_state hare;
+
+static inline bool node_alive(node* n) {
+    return n->level == 0 || n->marked;
+}
+
+void mark_node(node* n) {
+    if (node_alive(n)) {
+        return;
+    }
+    n->marked = true;
+    mark_node(n->nw);
+    mark_node(n->ne);
+    mark_node(n->sw);
+    mark_node(n->se);
+}
+
+// frees every node that can't be reached from root or the saved patterns, memoized results that were freed are forgotten
+// this can only be done between steps, since run_node has nodes that aren't reachable from anything yet
+void collect_nodes() {
+    mark_node(root);
+    for (uint16 i = 0; i < TORTOISEPHASES; i++) {
+        if (tortoise[i].root != NULL) {
+            mark_node(tortoise[i].root);
+        }
+    }
+    if (hare.root != NULL) {
+        mark_node(hare.root);
+    }
+    for (uint16 i = 1; i < 64; i++) {
+        if (empty_nodes[i] != NULL) {
+            mark_node(empty_nodes[i]);
+        }
+    }
+    for (uint32 i = 0; i < nodes_used; i++) {
+        node* n = &node_pool[i];
+        if (n->marked && n->result != NULL && !node_alive(n->result)) {
+            n->result = NULL;
+        }
+    }
+    clear_node_table();
+    live_nodes = 0;
+    free_nodes = NULL;
+    for (uint32 i = 0; i < nodes_used; i++) {
+        node* n = &node_pool[i];
+        if (n->marked) {
+            n->marked = false;
+            uint32 bucket = node_bucket(n->nw, n->ne, n->sw, n->se);
+            n->next = node_table[bucket];
+            node_table[bucket] = n;
+            live_nodes++;
+        } else {
+            n->next = free_nodes;
+            free_nodes = n;
+        }
+    }
+    if (TRACING(2)) {
+        printf("Collected hashlife nodes, %"PRIuFAST32" of %"PRIuFAST32" still used\n", live_nodes, nodes_used);
+    }
+}
+
+// runs the pattern for 2^step generations, collecting garbage and trying again if the nodes run out
+// returns false if it still didn't fit, which probably means it's exploding
+bool hashlife_run(uint16 step) {
+    node* start_root = root;
+    int64_t start_x = root_x;
+    int64_t start_y = root_y;
+    if (setjmp(hashlife_abort)) {
+        root = start_root;
+        root_x = start_x;
+        root_y = start_y;
+        collect_nodes();
+        if (live_nodes > HASHLIFEMAXNODES / 4 * 3) {
+            return false;
+        }
+        if (setjmp(hashlife_abort)) {
+            return false;
+        }
+        hashlife_step(step);
+        return true;
+    }
+    hashlife_step(step);
+    return true;
+}
+
+// runs the pattern for any number of generations
+bool hashlife_advance(uint64_t gens) {
+    for (uint16 step = 0; gens >> step != 0; step++) {
+        if (((gens >> step) & 1) && !hashlife_run(step)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// saves the pattern and the generations after it as the tortoise, this leaves the pattern at the last one
+bool save_tortoise() {
+    save_state(&tortoise[0]);
+    for (uint16 i = 1; i < TORTOISEPHASES; i++) {
+        if (!hashlife_run(0)) {
+            return false;
+        }
+        save_state(&tortoise[i]);
+    }
+    return true;
+}
+
+// compares the pattern with the tortoise, gens is the generations since the first phase of it
+// returns the closest phase that matches (and saves the pattern as hare) or -1
+int32_t match_tortoise(uint64_t gens) {
+    bool saved = false;
+    for (int32_t i = TORTOISEPHASES - 1; i >= 0; i--) {
+        if ((uint64_t)i == gens || tortoise[i].root->population != root->population) {
+            continue;
+        }
+        if (!saved) {
+            save_state(&hare);
+            saved = true;
+        }
+        if (same_pattern(&tortoise[i], &hare)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// runs the tortoise phase forward and checks if it's back to the same pattern
+// returns 1 if it is, 0 if it isn't and -1 if it ran out of nodes
+int16_t repeats_after(int32_t phase, uint64_t gens) {
+    root = tortoise[phase].root;
+    root_x = tortoise[phase].x;
+    root_y = tortoise[phase].y;
+    if (!hashlife_advance(gens)) {
+        return -1;
+    }
+    if (root->population != tortoise[phase].root->population) {
+        return 0;
+    }
+    save_state(&hare);
+    return same_pattern(&tortoise[phase], &hare);
+}
+
+// checks the current pattern for a ship with hashlife, returns the speed or 0
+uint64_t hashlife_check() {
+    hashlife_reset();
+    for (uint16 i = 0; i < TORTOISEPHASES; i++) {
+        tortoise[i].root = NULL;
+    }
+    hare.root = NULL;
+    if (setjmp(hashlife_abort)) {
+        // ran out of nodes, it's probably exploding
+        return 0;
+    }
+    uint16 level = 3;
+    while (((int64_t)1 << level) < right - left || ((int64_t)1 << level) < bottom - top) {
+        level++;
+    }
+    root = build_node(level, left, top);
+    root_x = left;
+    root_y = top;
+    if (!hashlife_run(HASHLIFESKIP) || root->population == 0 || !save_tortoise()) {
+        return 0;
+    }
+    // brent's algorithm, on steps of 2^HASHLIFESTEP generations
+    uint64_t gens = TORTOISEPHASES - 1;
+    uint64_t power = 1;
+    uint64_t steps = 0;
+    int32_t phase;
+    while ((phase = match_tortoise(gens)) < 0) {
+        if (steps == power) {
+            // a step covers TORTOISEPHASES generations, so this still finds every period up to HASHLIFEMAXPERIOD
+            if ((power << HASHLIFESTEP) > HASHLIFEMAXPERIOD) {
+                return 0;
             }
-            int32_t dx = current->left - data->left;
-            int32_t dy = current->top - data->top;
-            if (dx < 0) {
-                dx = -dx;
+            if (!save_tortoise()) {
+                return 0;
             }
-            if (dy < 0) {
-                dy = -dy;
+            gens = TORTOISEPHASES - 1;
+            power <<= 1;
+            steps = 0;
+            continue;
+        }
+        if (!hashlife_run(HASHLIFESTEP)) {
+            return 0;
+        }
+        gens += TORTOISEPHASES;
+        steps++;
+    }
+    // that's a multiple of the period, so divide out every prime factor that it still repeats without
+    uint64_t period = gens - phase;
+    uint64_t factors = period;
+    for (uint64_t q = 2; factors > 1; q++) {
+        if (q * q > factors) {
+            // what's left is prime
+            q = factors;
+        }
+        if (factors % q != 0) {
+            continue;
+        }
+        while (factors % q == 0) {
+            factors /= q;
+        }
+        while (period % q == 0) {
+            int16_t repeats = repeats_after(phase, period / q);
+            if (repeats < 0) {
+                return 0;
             }
-            if (dx == 0 || dy != 0) {
-                return period << 32;
-            } else {
-                #if REDUCEPERIOD > 0
-                uint16 num = gcd(dx, period);
-                dx /= num;
-                period /= num;
-                #endif
-                return ((uint64_t)period << 32) | (uint64_t)dx;
+            if (!repeats) {
+                break;
             }
-            not_found:;
+            period /= q;
         }
-        period += CHECKINTERVAL;
     }
-    return 0;
+    if (repeats_after(phase, period) != 1) {
+        return 0;
+    }
+    return make_speed((hare.x + hare.left) - (tortoise[phase].x + tortoise[phase].left), (hare.y + hare.top) - (tortoise[phase].y + tortoise[phase].top), period);
 }
 
+#endif
+
+
+// found ships are kept in a separate list for each direction class
+#define ORTHOGONAL 0
+#define DIAGONAL 1
+#define OBLIQUE 2
+#define DIRECTIONS 3
+
+const char* direction_names[DIRECTIONS] = {"orthogonal", "diagonal", "oblique"};
 
 uint32 ships = 0;
-uint64_t speeds[MAXSHIPS];
+uint32 direction_ships[DIRECTIONS] = {0};
+uint64_t speeds[DIRECTIONS][MAXSHIPS];
 char* rles;
+// the adaptive line of the state file when this search doesn't use it, so it gets written back as it was
+char* adaptive_line = NULL;
+
+static inline uint16 get_direction(uint64_t speed) {
+    uint64_t dx = speed & 65535;
+    uint64_t dy = (speed >> 16) & 65535;
+    if (dy == 0) {
+        return ORTHOGONAL;
+    } else if (dx == dy) {
+        return DIAGONAL;
+    } else {
+        return OBLIQUE;
+    }
+}
+
+// writes a speed in the usual notation: 2c/7 for orthogonal, 2c/9d for diagonal, (2,1)c/6 for oblique
+void format_speed(char* out, uint64_t speed) {
+    uint64_t dx = speed & 65535;
+    uint64_t dy = (speed >> 16) & 65535;
+    uint64_t period = speed >> 32;
+    switch (get_direction(speed)) {
+        case ORTHOGONAL:
+            sprintf(out, "%"PRIu64"c/%"PRIu64, dx, period);
+            break;
+        case DIAGONAL:
+            sprintf(out, "%"PRIu64"c/%"PRIu64"d", dx, period);
+            break;
+        default:
+            sprintf(out, "(%"PRIu64",%"PRIu64")c/%"PRIu64, dx, dy, period);
+            break;
+    }
+}
 
 uint64_t parse_speed(char* data, uint32 i, uint32 end) {
-    uint64_t out = atoi(data + i);
+    while (i < end && data[i] == ' ') {
+        i++;
+    }
+    uint64_t dx;
+    uint64_t dy = 0;
+    if (data[i] == '(') {
+        dx = atoi(data + i + 1);
+        for (; i < end; i++) {
+            if (data[i] == ',') {
+                break;
+            }
+        }
+        if (i == end) {
+            printf("Invalid speed\n");
+            exit(1);
+        }
+        dy = atoi(data + i + 1);
+    } else {
+        dx = atoi(data + i);
+    }
     uint32 begin_period = 0;
     for (; i < end; i++) {
         if (data[i] == '/') {
@@ -636,8 +2746,12 @@ uint64_t parse_speed(char* data, uint32 i, uint32 end) {
         printf("Invalid speed\n");
         exit(1);
     }
-    out |= (uint64_t)atoi(data + begin_period) << 32;
-    return out;
+    uint64_t period = strtoull(data + begin_period, NULL, 10);
+    for (i = begin_period; i < end && data[i] >= '0' && data[i] <= '9'; i++);
+    if (i < end && data[i] == 'd') {
+        dy = dx;
+    }
+    return (period << 32) | (dy << 16) | dx;
 }
 
 void read_state() {
@@ -657,7 +2771,10 @@ void read_state() {
         fclose(f);
         exit(1);
     }
-    ships = atoi(data);
+    ships = 0;
+    for (uint16 i = 0; i < DIRECTIONS; i++) {
+        direction_ships[i] = 0;
+    }
     uint32 i;
     for (i = 0; i < size; i++) {
         if (data[i] == '\n') {
@@ -670,11 +2787,13 @@ void read_state() {
     parse_speeds:;
     i++;
     uint32 start = i;
-    uint16 current_speed = 0;
     for (; i < size; i++) {
         if (data[i] == ' ') {
-            speeds[current_speed] = parse_speed(data, start, i);
-            current_speed++;
+            uint64_t speed = parse_speed(data, start, i);
+            uint16 direction = get_direction(speed);
+            speeds[direction][direction_ships[direction]] = speed;
+            direction_ships[direction]++;
+            ships++;
             start = i;
         } else if (data[i] == '\n') {
             goto parse_rles;
@@ -685,6 +2804,30 @@ void read_state() {
     exit(1);
     parse_rles:;
     i++;
+    free(adaptive_line);
+    adaptive_line = NULL;
+    if (size - i >= 9 && memcmp(data + i, "adaptive ", 9) == 0) {
+        i += 8;
+        uint32 line_start = i;
+        while (i < size && data[i] != '\n') {
+            i++;
+        }
+        char* line = malloc(i - line_start + 1);
+        memcpy(line, data + line_start, i - line_start);
+        line[i - line_start] = '\0';
+        #if ADAPTIVE > 0
+        if (use_random_soups) {
+            read_adaptive(line);
+            free(line);
+            line = NULL;
+        }
+        #endif
+        adaptive_line = line;
+        i++;
+    }
+    if (i > size) {
+        i = size;
+    }
     uint32 rle_size = size - i;
     if (rles != NULL) {
         free(rles);
@@ -701,22 +2844,38 @@ void read_state() {
     #endif
 }
 
-void add_ship(uint64_t speed) {
-    #if SKIPDUPLICATES > 0
-    for (uint16 i = 0; i < ships; i++) {
-        if (speeds[i] == speed) {
-            #if SHOWDUPLICATES > 0
-            if (speed != MOSTCOMMONSPEED && speed != MOSTCOMMONSPEED2) {
-                printf("Duplicate %"PRIu64"c/%"PRIu64" found\n", speed & 65535, speed >> 32);
-            }
+// writes the cells of a pattern (height rows of width cells, stride apart) as an rle, without the header
+void write_rle(FILE* f, uint8_t* cells, uint32 stride, uint16 height, uint16 width) {
+    char prev = '\0';
+    uint16 count = 0;
+    #define addchar(c) { \
+        if (prev == (c)) { \
+            count++; \
+        } else { \
+            for (uint16 i = 0; i < count; i++) { \
+                fputc(prev, f); \
+            } \
+            prev = (c); \
+            count = 1; \
+        } \
+    }
+    for (uint16 y = 0; y < height; y++) {
+        uint8_t* row = cells + y * stride;
+        for (uint16 x = 0; x < width; x++) {
+            #if STATES > 2
+            addchar(row[x] ? 'A' + row[x] - 1 : '.');
+            #else
+            addchar(row[x] ? 'o' : 'b');
             #endif
-            return;
         }
+        addchar('$');
     }
-    #endif
-    speeds[ships] = speed;
-    ships++;
-    printf("%"PRIu64"c/%"PRIu64" found! (%"PRIuFAST16" NRSS total)\n", speed & 65535, speed >> 32, ships);
+    #undef addchar
+    fprintf(f, "!\n");
+}
+
+// writes the state file, if speed isn't 0 the current soup gets added as the ship with that speed
+void write_state(uint64_t speed) {
     #ifndef BRUH
     FILE* f = fopen(state_file, "w");
     if (f == 0) {
@@ -724,221 +2883,1381 @@ void add_ship(uint64_t speed) {
         exit(1);
     }
     #else
+    FILE* f = stdout;
     printf("=== begin file data ===\n");
     #define fprintf(x, y, ...) printf(y, ## __VA_ARGS__)
     #define fputc(char, f) printf("%c", char)
     #endif
-    fprintf(f, "%"PRIuFAST32" NRSS\n", ships);
-    for (uint16 i = 0; i < ships; i++) {
-        fprintf(f, "%"PRIu64"c/%"PRIu64" ", speeds[i] & 65535, speeds[i] >> 32);
+    fprintf(f, "%"PRIuFAST32" NRSS (%"PRIuFAST32" %s, %"PRIuFAST32" %s, %"PRIuFAST32" %s)\n", ships, direction_ships[ORTHOGONAL], direction_names[ORTHOGONAL], direction_ships[DIAGONAL], direction_names[DIAGONAL], direction_ships[OBLIQUE], direction_names[OBLIQUE]);
+    char other_str[32];
+    for (uint16 i = 0; i < DIRECTIONS; i++) {
+        for (uint16 j = 0; j < direction_ships[i]; j++) {
+            format_speed(other_str, speeds[i][j]);
+            fprintf(f, "%s ", other_str);
+        }
+    }
+    #ifndef BRUH
+    if (adaptive_line != NULL) {
+        fprintf(f, "\nadaptive%s", adaptive_line);
+    }
+    #endif
+    #if ADAPTIVE > 0 && !defined(BRUH)
+    if (use_random_soups) {
+        fprintf(f, "\nadaptive");
+        write_arms(f, "gaps", &gap_arms);
+        write_arms(f, "xs", &x_arms);
+        write_arms(f, "engines", &engine_arms);
     }
+    #endif
     // printf("ships: %"PRIuFAST16"\n", ships);
     #ifndef BRUH
-    if (ships != 1 && rles != NULL) {
+    if ((speed == 0 || ships != 1) && rles != NULL) {
         fprintf(f, "\n%s", rles);
     }
     #endif
-    fprintf(f, "\n# %"PRIu64"c/%"PRIu64" ", speed & 65535, speed >> 32);
+    if (speed == 0) {
+        fprintf(f, "\n");
+        goto done;
+    }
+    char speed_str[32];
+    format_speed(speed_str, speed);
+    fprintf(f, "\n# %s ", speed_str);
     uint16 height = ip_bottom - STARTY;
     uint16 width = ip_right - STARTX;
     fprintf(f, "\nx = %"PRIuFAST16", y = %"PRIuFAST16", rule = "RULESTR"\n", width, height);
-    uint32 stop = ((uint32)ip_bottom << WIDTH) + STARTX;
-    uint32 max = (STARTY << WIDTH) + ip_right;
-    char prev = '\0';
-    uint16 count = 0;
-    #define addchar(c) { \
-        if (prev == (c)) { \
-            count++; \
-        } else { \
-            for (uint16 i = 0; i < count; i++) { \
-                fputc(prev, f); \
-            } \
-            prev = (c); \
-            count = 1; \
-        } \
+    uint8_t* cells = malloc((uint32)height * width);
+    render_soup(cells);
+    write_rle(f, cells, width, height, width);
+    free(cells);
+    done:;
+    #ifndef BRUH
+    fclose(f);
+    read_state();
+    #else
+    printf("=== end file data ===\n");
+    #undef fprintf
+    #undef fputc
+    #endif
+}
+
+#if MINIMIZETHREADS > 0 && !defined(BRUH)
+
+/*
+background minimization
+when a new ship is found the engines of the soup get copied into a job for the minimize threads
+they take engines out one at a time (keeping each removal that still gives the same speed), then do the same with single cells
+every try is run the same way run_soup runs soups, with the budget and check interval from when the ship was found
+ships that hashlife found only show up after the budget, so their tries go on to hashlife_check the same way
+finished jobs are picked up by the main thread between soups, which adds them to the state file
+*/
+
+typedef struct minimize_job {
+    uint64_t speed;
+    uint32 max_gens;
+    uint32 interval;
+    // whether the ship was found by hashlife
+    bool hashlife;
+    // the engines, in the order they were placed, with positions relative to STARTX and STARTY
+    uint16 engine_count;
+    uint16* engine_x;
+    uint16* engine_y;
+    engine_phase** phases;
+    // the size of the soup, and the result, cells is NULL if the original soup didn't give the same speed
+    uint16 height;
+    uint16 width;
+    uint8_t* cells;
+    uint16 engines_left;
+    uint32 population;
+    uint32 original_population;
+    struct minimize_job* next;
+} minimize_job;
+
+pthread_mutex_t minimize_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t minimize_available = PTHREAD_COND_INITIALIZER;
+minimize_job* minimize_queue = NULL;
+minimize_job* minimize_done = NULL;
+// jobs that haven't been picked up by the main thread yet
+volatile sig_atomic_t minimize_pending = 0;
+
+// runs the pattern in data the way run_soup does, returns the speed it finds or 0
+// if hashlife is true patterns that are still going after max_gens get checked with hashlife_check too
+uint64_t pattern_speed(uint32 max_gens, uint32 interval, bool hashlife) {
+    #if STATES > 2
+    pack_data();
+    #endif
+    phase_number = 0;
+    cached_phases = 0;
+    uint64_t speed = 0;
+    for (uint32 i = 0; i < max_gens; i++) {
+        if (top < 2 || bottom > HEIGHTVALUE - 2 || left < 2 || right > WIDTHVALUE - 2) {
+            break;
+        }
+        if (!run_generation()) {
+            break;
+        }
+        if (i % interval == 0) {
+            #if STATES > 2
+            unpack_data();
+            #endif
+            cache_phase();
+            uint32 match = find_matching_phase();
+            if (match != UINT_FAST32_MAX) {
+                pattern_data* current = phase_cache[phase_number];
+                pattern_data* prev = phase_cache[match];
+                speed = make_speed((int64_t)current->left - (int64_t)prev->left, (int64_t)current->top - (int64_t)prev->top, (phase_number - match) * interval);
+                break;
+            }
+            phase_number++;
+        }
     }
-    for (uint32 start = (STARTY << WIDTH) + STARTX; start < stop; start += WIDTHVALUE) {
-        for (uint32 i = start; i < max; i++) {
-            addchar(initial_pattern[i] ? 'o' : 'b');
+    for (uint32 i = 0; i < cached_phases; i++) {
+        free(phase_cache[i]);
+    }
+    #if HASHLIFE > 0
+    // patterns that died have an empty bounding box
+    if (hashlife && speed == 0 && top < bottom) {
+        speed = hashlife_check();
+    }
+    #endif
+    return speed;
+}
+
+// puts the engines that aren't removed into cells, the same way create_soup does
+void build_minimize_soup(minimize_job* job, bool* removed, uint8_t* cells) {
+    memset(cells, 0, (uint32)job->height * job->width);
+    for (uint16 i = 0; i < job->engine_count; i++) {
+        if (removed[i]) {
+            continue;
+        }
+        engine_phase* phase = job->phases[i];
+        for (uint16 cy = 0; cy < phase->height; cy++) {
+            memcpy(cells + (uint32)(job->engine_y[i] + cy) * job->width + job->engine_x[i], phase->data + cy * phase->width, phase->width);
+        }
+    }
+}
+
+// whether cells still give the speed of the job
+bool same_ship(minimize_job* job, uint8_t* cells) {
+    clear();
+    uint32 population = 0;
+    for (uint16 y = 0; y < job->height; y++) {
+        uint8_t* row = cells + (uint32)y * job->width;
+        memcpy(data + ((uint32)(STARTY + y) << WIDTH) + STARTX, row, job->width);
+        for (uint16 x = 0; x < job->width; x++) {
+            population += row[x] != 0;
+        }
+    }
+    top = STARTY;
+    bottom = STARTY + job->height;
+    left = STARTX;
+    right = STARTX + job->width;
+    return population > 0 && pattern_speed(job->max_gens, job->interval, job->hashlife) == job->speed;
+}
+
+void minimize(minimize_job* job) {
+    phase_cache = malloc((job->max_gens / job->interval + 1) * sizeof(pattern_data*));
+    uint32 size = (uint32)job->height * job->width;
+    uint8_t* cells = malloc(size);
+    bool* removed = calloc(job->engine_count, sizeof(bool));
+    build_minimize_soup(job, removed, cells);
+    job->original_population = 0;
+    for (uint32 i = 0; i < size; i++) {
+        job->original_population += cells[i] != 0;
+    }
+    if (!same_ship(job, cells)) {
+        free(cells);
+        job->cells = NULL;
+        goto done;
+    }
+    // engines first, since that takes out lots of cells with each try
+    job->engines_left = job->engine_count;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int32_t i = job->engine_count - 1; i >= 0; i--) {
+            if (removed[i]) {
+                continue;
+            }
+            removed[i] = true;
+            build_minimize_soup(job, removed, cells);
+            if (same_ship(job, cells)) {
+                job->engines_left--;
+                changed = true;
+            } else {
+                removed[i] = false;
+            }
+        }
+    }
+    build_minimize_soup(job, removed, cells);
+    // then single cells
+    for (uint32 i = 0; i < size; i++) {
+        if (cells[i] == 0) {
+            continue;
+        }
+        uint8_t state = cells[i];
+        cells[i] = 0;
+        if (!same_ship(job, cells)) {
+            cells[i] = state;
+        }
+    }
+    job->cells = cells;
+    job->population = 0;
+    for (uint32 i = 0; i < size; i++) {
+        job->population += cells[i] != 0;
+    }
+    done:;
+    free(removed);
+    free(phase_cache);
+}
+
+void* minimize_worker(void* arg) {
+    // signals should go to the main thread
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    soup_trace = 0;
+    #ifdef __linux__
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+    #endif
+    pthread_mutex_lock(&minimize_lock);
+    while (true) {
+        while (minimize_queue == NULL) {
+            pthread_cond_wait(&minimize_available, &minimize_lock);
+        }
+        minimize_job* job = minimize_queue;
+        minimize_queue = job->next;
+        pthread_mutex_unlock(&minimize_lock);
+        minimize(job);
+        pthread_mutex_lock(&minimize_lock);
+        job->next = minimize_done;
+        minimize_done = job;
+    }
+    return NULL;
+}
+
+void init_minimize() {
+    for (uint16 i = 0; i < MINIMIZETHREADS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, minimize_worker, NULL) != 0) {
+            perror("Error starting minimize thread");
+            exit(1);
+        }
+        pthread_detach(thread);
+    }
+}
+
+// queues the current soup to be minimized
+void minimize_ship(uint64_t speed, bool hashlife) {
+    minimize_job* job = malloc(sizeof(minimize_job));
+    job->speed = speed;
+    job->hashlife = hashlife;
+    job->max_gens = max_period;
+    job->interval = check_interval;
+    job->height = ip_bottom - STARTY;
+    job->width = ip_right - STARTX;
+    job->engine_count = current_soup->engine_count;
+    job->engine_x = malloc(sizeof(uint16) * job->engine_count);
+    job->engine_y = malloc(sizeof(uint16) * job->engine_count);
+    job->phases = malloc(sizeof(engine_phase*) * job->engine_count);
+    uint16 y = 0;
+    for (uint16 i = 0; i < job->engine_count; i++) {
+        engine_info engine = current_soup->engines[i];
+        engine_phase* phase = engine_phases[engine.phase];
+        y += engine.y;
+        job->engine_x[i] = engine.x;
+        job->engine_y[i] = y;
+        // the phases are copied so generate_phases can't change them while the job runs
+        job->phases[i] = malloc(sizeof(engine_phase) + phase->height * phase->width);
+        memcpy(job->phases[i], phase, sizeof(engine_phase) + phase->height * phase->width);
+    }
+    minimize_pending++;
+    pthread_mutex_lock(&minimize_lock);
+    job->next = minimize_queue;
+    minimize_queue = job;
+    pthread_cond_signal(&minimize_available);
+    pthread_mutex_unlock(&minimize_lock);
+}
+
+// puts entry (an rle with its header, ending in a newline) into rles right after the last ship with the header "# speed_str "
+// it goes at the end if that ship isn't there any more
+void insert_minimized(char* speed_str, char* entry) {
+    char header[40];
+    snprintf(header, sizeof(header), "# %s \n", speed_str);
+    size_t rles_length = rles == NULL ? 0 : strlen(rles);
+    size_t at = rles_length;
+    char* found = NULL;
+    for (char* next = rles == NULL ? NULL : strstr(rles, header); next != NULL; next = strstr(next + 1, header)) {
+        found = next;
+    }
+    if (found != NULL) {
+        char* end = strchr(found, '!');
+        if (end != NULL && end[1] == '\n') {
+            at = end + 2 - rles;
+        }
+    }
+    size_t entry_length = strlen(entry);
+    char* out = malloc(rles_length + entry_length + 2);
+    if (at > 0) {
+        memcpy(out, rles, at);
+    }
+    if (at == rles_length) {
+        // rles doesn't end with a newline, write_state adds that
+        size_t length = at;
+        if (at > 0) {
+            out[length++] = '\n';
+        }
+        memcpy(out + length, entry, entry_length - 1);
+        out[length + entry_length - 1] = '\0';
+    } else {
+        memcpy(out + at, entry, entry_length);
+        memcpy(out + at + entry_length, rles + at, rles_length - at + 1);
+    }
+    free(rles);
+    rles = out;
+}
+
+// adds the minimized ships that are done to the state file, if wait is true it waits for all of them
+void finish_minimized(bool wait) {
+    while (minimize_pending > 0) {
+        pthread_mutex_lock(&minimize_lock);
+        minimize_job* job = minimize_done;
+        minimize_done = NULL;
+        pthread_mutex_unlock(&minimize_lock);
+        if (job == NULL) {
+            if (!wait) {
+                return;
+            }
+            usleep(10000);
+            continue;
+        }
+        while (job != NULL) {
+            char speed_str[32];
+            format_speed(speed_str, job->speed);
+            if (job->cells == NULL) {
+                printf("Couldn't minimize %s, the soup didn't give the same speed again\n", speed_str);
+            } else {
+                printf("Minimized %s from %"PRIuFAST16" engines (population %"PRIuFAST32") to %"PRIuFAST16" (population %"PRIuFAST32")\n", speed_str, job->engine_count, job->original_population, job->engines_left, job->population);
+                // the result is cropped to its bounding box
+                uint16 min_x = job->width;
+                uint16 max_x = 0;
+                uint16 min_y = job->height;
+                uint16 max_y = 0;
+                for (uint16 y = 0; y < job->height; y++) {
+                    for (uint16 x = 0; x < job->width; x++) {
+                        if (job->cells[(uint32)y * job->width + x]) {
+                            min_x = x < min_x ? x : min_x;
+                            max_x = x > max_x ? x : max_x;
+                            min_y = y < min_y ? y : min_y;
+                            max_y = y;
+                        }
+                    }
+                }
+                char* entry;
+                size_t entry_size;
+                FILE* f = open_memstream(&entry, &entry_size);
+                fprintf(f, "# %s minimized\nx = %"PRIuFAST16", y = %"PRIuFAST16", rule = "RULESTR"\n", speed_str, max_x - min_x + 1, max_y - min_y + 1);
+                write_rle(f, job->cells + (uint32)min_y * job->width + min_x, job->width, max_y - min_y + 1, max_x - min_x + 1);
+                fclose(f);
+                // it goes right under the original ship
+                insert_minimized(speed_str, entry);
+                free(entry);
+                write_state(0);
+                free(job->cells);
+            }
+            for (uint16 i = 0; i < job->engine_count; i++) {
+                free(job->phases[i]);
+            }
+            free(job->phases);
+            free(job->engine_x);
+            free(job->engine_y);
+            minimize_job* next = job->next;
+            free(job);
+            job = next;
+            minimize_pending--;
+        }
+    }
+}
+
+#endif
+
+// hashlife is whether the ship was found by hashlife_check
+void add_ship(uint64_t speed, bool hashlife) {
+    char speed_str[32];
+    format_speed(speed_str, speed);
+    uint16 direction = get_direction(speed);
+    #if SKIPDUPLICATES > 0
+    for (uint16 i = 0; i < direction_ships[direction]; i++) {
+        if (speeds[direction][i] == speed) {
+            #if SHOWDUPLICATES > 0
+            if (speed != MOSTCOMMONSPEED && speed != MOSTCOMMONSPEED2) {
+                printf("Duplicate %s found\n", speed_str);
+            }
+            #endif
+            #if ADAPTIVE > 0
+            if (speed != MOSTCOMMONSPEED && speed != MOSTCOMMONSPEED2 && soup_reward < 1) {
+                soup_reward = 1;
+            }
+            #endif
+            return;
+        }
+    }
+    #endif
+    speeds[direction][direction_ships[direction]] = speed;
+    direction_ships[direction]++;
+    ships++;
+    printf("%s found! (%"PRIuFAST32" %s, %"PRIuFAST32" NRSS total)\n", speed_str, direction_ships[direction], direction_names[direction], ships);
+    #if ADAPTIVE > 0
+    soup_reward = ADAPTIVENEWREWARD;
+    #endif
+    write_state(speed);
+    #if MINIMIZETHREADS > 0 && !defined(BRUH)
+    minimize_ship(speed, hashlife);
+    #endif
+}
+
+
+uint64 soup_count;
+
+
+// cpu time used by this thread in nanoseconds, so other threads and other programs don't get counted
+static inline uint64_t thread_time() {
+    #ifdef BRUH
+    return (uint64_t)clock() * (1000000000 / CLOCKS_PER_SEC);
+    #else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    #endif
+}
+
+// wall clock time in nanoseconds, for things that should happen every so many seconds however many threads are busy
+static inline uint64_t wall_time() {
+    #ifdef BRUH
+    // there's only one thread then, so cpu time is close enough
+    return (uint64_t)clock() * (1000000000 / CLOCKS_PER_SEC);
+    #else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    #endif
+}
+
+
+#if AUTOTUNE > 0
+
+/*
+auto-tuning
+each round tries half the current check interval, the current one and double it, and the fastest one is kept
+the 3 intervals take turns soup by soup, so they're timed on the same mix of soups instead of 3 different runs of soups
+the budget only changes between rounds, so all 3 intervals in a round are timed with the same budget
+*/
+
+// the largest budget it can pick (max-period)
+uint32 tune_max_gens;
+// how many soups ended in each 16 generations, this is halved every round
+uint32* tune_lifetimes;
+// the latest generation that a ship was confirmed at
+uint32 tune_ship_gen = 0;
+// the intervals being tried this round, and how much cpu time the soups with each one took
+uint32 tune_intervals[3];
+uint64_t tune_times[3] = {0};
+uint32 tune_soups = 0;
+uint64_t tune_start;
+
+void set_tune_intervals(uint32 center) {
+    tune_intervals[0] = center / 2 < AUTOTUNEMININTERVAL ? AUTOTUNEMININTERVAL : center / 2;
+    tune_intervals[1] = center;
+    tune_intervals[2] = center * 2 > AUTOTUNEMAXINTERVAL ? AUTOTUNEMAXINTERVAL : center * 2;
+}
+
+void init_autotune() {
+    tune_max_gens = max_period;
+    tune_lifetimes = calloc(tune_max_gens / 16 + 1, sizeof(uint32));
+    check_interval = CHECKINTERVAL < AUTOTUNEMININTERVAL ? AUTOTUNEMININTERVAL : (CHECKINTERVAL > AUTOTUNEMAXINTERVAL ? AUTOTUNEMAXINTERVAL : CHECKINTERVAL);
+    set_tune_intervals(check_interval);
+    check_interval = tune_intervals[0];
+    tune_start = thread_time();
+    printf("Auto-tuning the budget between %"PRIuFAST32" and %"PRIuFAST32" generations and the check interval between %d and %d generations\n", (uint32)AUTOTUNEMINGENS, tune_max_gens, AUTOTUNEMININTERVAL, AUTOTUNEMAXINTERVAL);
+}
+
+// picks the budget from when soups have been ending
+// if a lot of soups end just before the budget then more would have ended just after it, so it grows, otherwise it shrinks to fit
+uint32 tune_budget() {
+    uint32 buckets = tune_max_gens / 16 + 1;
+    uint64_t total = 0;
+    for (uint32 i = 0; i < buckets; i++) {
+        total += tune_lifetimes[i];
+    }
+    // the generation that all but AUTOTUNEMISS of the soups ended by, plus a fifth
+    uint64_t count = 0;
+    uint32 i;
+    for (i = 0; i < buckets - 1; i++) {
+        count += tune_lifetimes[i];
+        if (count >= total * (1 - AUTOTUNEMISS)) {
+            break;
+        }
+    }
+    uint32 out = (i + 1) * 16 * 5 / 4;
+    // ships shouldn't get cut off either
+    if (out < tune_ship_gen * 2) {
+        out = tune_ship_gen * 2;
+    }
+    if (out < AUTOTUNEMINGENS) {
+        out = AUTOTUNEMINGENS;
+    }
+    if (out > tune_max_gens) {
+        out = tune_max_gens;
+    }
+    return out;
+}
+
+// called after every soup with the generation it got to and whether it was still running
+void autotune_soup(uint32 gens, bool timed_out) {
+    if (!timed_out) {
+        tune_lifetimes[(gens < tune_max_gens ? gens : tune_max_gens) / 16]++;
+    }
+    uint64_t current = thread_time();
+    tune_times[tune_soups % 3] += current - tune_start;
+    tune_start = current;
+    tune_soups++;
+    if (tune_soups < AUTOTUNESOUPS * 3) {
+        check_interval = tune_intervals[tune_soups % 3];
+        return;
+    }
+    tune_soups = 0;
+    // the timing is noisy, so the interval only moves if the other one is at least 2% faster
+    uint16 best = 1;
+    for (uint16 i = 0; i < 3; i += 2) {
+        if (tune_times[i] * 50 < tune_times[1] * 49 && tune_times[i] < tune_times[best]) {
+            best = i;
+        }
+    }
+    uint32 prev_period = max_period;
+    uint32 prev_interval = tune_intervals[1];
+    max_period = tune_budget();
+    set_tune_intervals(tune_intervals[best]);
+    if (max_period != prev_period || tune_intervals[1] != prev_interval) {
+        printf("Auto-tuned to a budget of %"PRIuFAST32" generations and a check interval of %"PRIuFAST32" generations\n", max_period, tune_intervals[1]);
+    }
+    check_interval = tune_intervals[0];
+    for (uint16 i = 0; i < 3; i++) {
+        tune_times[i] = 0;
+    }
+    uint32 buckets = tune_max_gens / 16 + 1;
+    for (uint32 i = 0; i < buckets; i++) {
+        tune_lifetimes[i] >>= 1;
+    }
+}
+
+void free_autotune() {
+    printf("Auto-tuned budget: %"PRIuFAST32" generations, check interval: %"PRIuFAST32" generations\n", max_period, tune_intervals[1]);
+    free(tune_lifetimes);
+}
+
+#endif
+
+// checks the newest cached phase for a ship, returns whether the soup is done
+bool check_phase() {
+    profile_begin();
+    uint64_t speed = check_for_spaceship();
+    profile_end(STAGE_CHECK_FOR_SPACESHIP);
+    if (speed != 0) {
+        if ((speed >> 32) < MINPERIOD) {
+            if (TRACING(1)) {
+                printf("complete, less than min period\n");
+            }
+            return true;
         }
-        max += WIDTHVALUE;
-        addchar('$');
+        #if SKIPOSCILLATORS > 0
+        if ((speed & 65535) == 0) {
+            if (TRACING(1)) {
+                printf("complete, skipped oscillator\n");
+            }
+            return true;
+        }
+        #endif
+        if (TRACING(1)) {
+            printf("complete, true\n");
+        }
+        #if AUTOTUNE > 0
+        if (phase_number * check_interval > tune_ship_gen) {
+            tune_ship_gen = phase_number * check_interval;
+        }
+        #endif
+        profile_begin();
+        add_ship(speed, false);
+        profile_end(STAGE_ADD_SHIP);
+        return true;
     }
-    #undef addchar
-    fprintf(f, "!\n");
-    #ifndef BRUH
-    fclose(f);
-    read_state();
-    #else
-    printf("=== end file data ===\n");
-    #endif
+    if (TRACING(1)) {
+        printf("complete, false\n");
+    }
+    return false;
 }
 
+// shows the soups in soup_history, oldest first
+void show_soup_history() {
+    if (use_random_soups) {
+        printf("Recent soups (seed %016"PRIx64" %016"PRIx64" %016"PRIx64" %016"PRIx64"):\n", rng_seed[0], rng_seed[1], rng_seed[2], rng_seed[3]);
+    } else {
+        printf("Recent soups:\n");
+    }
+    for (uint64 n = soup_count < SOUPHISTORY ? 0 : soup_count - SOUPHISTORY + 1; n <= soup_count; n++) {
+        soup_record* record = &soup_history[n % SOUPHISTORY];
+        if (record->soup != n || record->engine_count == 0) {
+            continue;
+        }
+        printf("soup %"PRIuFAST64": ", n);
+        if (use_random_soups) {
+            printf("random number %"PRIu64", ", record->rng_position);
+        }
+        printf("%"PRIuFAST16"x%"PRIuFAST16" at x = %"PRIuFAST16", y = %"PRIuFAST16", ", record->right - record->left, record->bottom - record->top, record->left, record->top);
+        if (record->running) {
+            printf("still running");
+        } else {
+            printf("ran for %"PRIuFAST32" generations", record->generations);
+        }
+        printf(", replay with -r ");
+        for (uint16 i = 0; i < record->engine_count; i++) {
+            engine_info engine = record->engines[i];
+            printf("%s%"PRIuFAST16",%"PRIuFAST16",%"PRIuFAST16, i == 0 ? "" : ":", engine.phase, engine.x, engine.y);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
 
-uint64 soup_count;
+void print_pattern() {
+    uint16 height = bottom - top + 2;
+    uint16 width = right - left + 2;
+    printf("x = %"PRIuFAST16", y = %"PRIuFAST16"\n", width, height);
+    char* row = malloc((width + 1) * sizeof(char));
+    row[width] = '\0';
+    for (uint16 y = top - 1; y < bottom + 1; y++) {
+        uint32 i = ((uint32)y << WIDTH) + left - 1;
+        for (uint16 x = 0; x < width; x++) {
+            row[x] = '0' + data[i];
+            i++;
+        }
+        printf("%s\n", row);
+    }
+    free(row);
+}
 
 void run_soup() {
-    #if DEBUG > 0
-    printf("Creating soup... ");
-    #endif
+    soup_trace = tracing && soup_count % trace_every == 0 ? trace_level : 0;
+    current_soup = &soup_history[soup_count % SOUPHISTORY];
+    current_soup->soup = soup_count;
+    current_soup->engine_count = 0;
+    current_soup->running = true;
+    if (use_random_soups) {
+        current_soup->rng_position = rng_position();
+    }
+    if (TRACING(1)) {
+        printf("Creating soup... ");
+    }
+    profile_begin();
     create_soup();
-    #if DEBUG > 0
-    printf("complete\n");
+    #if STATES > 2
+    pack_data();
     #endif
+    profile_end(STAGE_CREATE_SOUP);
+    current_soup->top = top;
+    current_soup->bottom = bottom;
+    current_soup->left = left;
+    current_soup->right = right;
+    if (TRACING(1)) {
+        printf("complete\n");
+    }
     phase_number = 0;
-    uint64_t speed;
-    // #define topm1 (top - 1)
-    // #define bottomp1 (bottom + 1)
-    // #define leftm1 (left - 1)
-    // #define rightp1 (right + 1)
-    // #define heightp2 (bottomp1 - topm1)
-    // #define widthp2 (rightp1 - leftm1)
-    // printf("top: %"PRIuFAST16", bottom: %"PRIuFAST16", left: %"PRIuFAST16", right: %"PRIuFAST16, top, bottom, left, right);
-    // printf("\nx = %"PRIuFAST16", y = %"PRIuFAST16"\n", widthp2, heightp2);
-    // char* row = malloc((widthp2 + 1) * sizeof(char));
-    // row[widthp2] = '\0';
-    // for (uint16 y = topm1; y < bottomp1; y++) {
-    //     uint32 i = ((uint32)y << WIDTH) + leftm1;
-    //     for (uint16 x = 0; x < widthp2; x++) {
-    //         row[x] = data[i] ? 'o' : 'b';
-    //         i++;
-    //     }
-    //     printf("%s$", row);
-    // }
-    // free(row);
-    uint16 i;
+    cached_phases = 0;
+    uint32 start_gen = 0;
+    bool finished = false;
+    #if PREFILTERGENS > 0
+    profile_begin();
+    bool kept = prefilter(&start_gen);
+    profile_end(STAGE_PREFILTER);
+    if (!kept) {
+        if (TRACING(1)) {
+            printf("Soup thrown out by prefilter\n");
+        }
+        finished = true;
+    } else {
+        // check the phases the prefilter cached
+        uint32 prefilter_phases = phase_number;
+        for (phase_number = 0; phase_number < prefilter_phases; phase_number++) {
+            if (check_phase()) {
+                // the full simulation would have stopped when it cached this phase
+                start_gen = phase_number * check_interval;
+                finished = true;
+                break;
+            }
+        }
+    }
+    #endif
+    if (TRACING(2)) {
+        print_pattern();
+    }
+    uint32 i;
+    uint32 generations = 0;
     // clock_t start_time = clock();
-    for (i = 0; i < max_period; i++) {
-        uint16 pop = 0;
-        uint32 stop = ((uint32)bottom << WIDTH) + left;
-        uint32 max = ((uint32)top << WIDTH) + right;
-        for (uint32 start = (top << WIDTH) + left; start < stop; start += WIDTHVALUE) {
-            for (uint32 i = start; i < max; i++) {
-                if (data[i]) {
-                    pop++;
+    profile_loop_begin();
+    for (i = start_gen; i < max_period && !finished; i++) {
+        if (TRACING(1)) {
+            #if STATES > 2
+            unpack_data();
+            #endif
+            uint32 pop = 0;
+            uint32 stop = ((uint32)bottom << WIDTH) + left;
+            uint32 max = ((uint32)top << WIDTH) + right;
+            for (uint32 start = (top << WIDTH) + left; start < stop; start += WIDTHVALUE) {
+                for (uint32 i = start; i < max; i++) {
+                    if (data[i]) {
+                        pop++;
+                    }
                 }
+                max += WIDTHVALUE;
+            }
+            printf("Running generation %"PRIuFAST32" (population %"PRIuFAST32")\n", i, pop);
+            if (TRACING(2)) {
+                print_pattern();
             }
-            max += WIDTHVALUE;
         }
-        #if DEBUG > 0
-        #define topm1 (top - 1)
-        #define bottomp1 (bottom + 1)
-        #define leftm1 (left - 1)
-        #define rightp1 (right + 1)
-        #define heightp2 (bottomp1 - topm1)
-        #define widthp2 (rightp1 - leftm1)
-        printf("Running generation %"PRIuFAST16" (population %"PRIuFAST32")\n", i, pop);
-        #if DEBUG > 1
-        printf("x = %"PRIuFAST16", y = %"PRIuFAST16"\n", widthp2, heightp2);
-        char* row = malloc((widthp2 + 1) * sizeof(char));
-        row[widthp2] = '\0';
-        for (uint16 y = topm1; y < bottomp1; y++) {
-            uint32 i = ((uint32)y << WIDTH) + leftm1;
-            for (uint16 x = 0; x < widthp2; x++) {
-                row[x] = data[i] ? '1' : '0';
-                i++;
-            }
-            printf("%s\n", row);
-        }
-        free(row);
-        #endif
-        #endif
         if (top < 2 || bottom > HEIGHTVALUE - 2 || left < 2 || right > WIDTHVALUE - 2) {
             break;
         }
-        if (!run_generation()) {
+        bool alive = run_generation();
+        generations++;
+        if (!alive) {
+            finished = true;
             break;
         }
-        if (i % CHECKINTERVAL == 0) {
-            #if DEBUG > 0
-            printf("Checking for spaceship... ");
+        if (i % check_interval == 0) {
+            if (TRACING(1)) {
+                printf("Checking for spaceship... ");
+            }
+            profile_begin();
+            #if STATES > 2
+            unpack_data();
             #endif
             cache_phase();
-            if ((speed = check_for_spaceship()) != 0) {
-                if ((speed >> 32) < MINPERIOD) {
-                    #if DEBUG > 0
-                    printf("complete, less than min period\n");
-                    #endif
-                    break;
-                }
-                #if SKIPOSCILLATORS > 0
-                if ((speed & 65535) == 0) {
-                    #if DEBUG > 0
-                    printf("complete, skipped oscillator\n");
-                    #endif
-                    break;
-                }
-                #endif
-                #if DEBUG > 0
-                printf("complete, true\n");
-                #endif
-                add_ship(speed);
+            profile_end(STAGE_CACHE_PHASE);
+            if (check_phase()) {
+                finished = true;
                 break;
             }
             phase_number++;
-            #if DEBUG > 0
-            printf("complete, false\n");
-            #endif
         }
     }
-    for (uint16 i = 0; i < phase_number; i++) {
+    profile_loop_end(generations);
+    #if HASHLIFE > 0
+    if (!finished) {
+        if (TRACING(1)) {
+            printf("Checking with hashlife... ");
+        }
+        uint64_t speed = hashlife_check();
+        if (TRACING(1)) {
+            printf("complete\n");
+        }
+        if (speed != 0 && (speed >> 32) >= MINPERIOD && (SKIPOSCILLATORS == 0 || (speed & 65535) != 0)) {
+            profile_begin();
+            add_ship(speed, true);
+            profile_end(STAGE_ADD_SHIP);
+        }
+    }
+    #endif
+    for (uint32 i = 0; i < cached_phases; i++) {
         free(phase_cache[i]);
     }
+    #if ADAPTIVE > 0
+    if (use_random_soups) {
+        // soups that were still going at the end are worth looking at too, but not ones that hit the edge or exploded
+        if (!finished && i >= max_period && soup_reward < 1) {
+            soup_reward = 1;
+        }
+        finish_adaptive_soup();
+    }
+    #endif
     // printf("Soup stabilized after %"PRIuFAST16" generations (%.3f seconds)\n", i, (double)(clock() - start_time) / (double)CLOCKS_PER_SEC);
+    current_soup->running = false;
+    current_soup->generations = i;
+    #if AUTOTUNE > 0
+    autotune_soup(i, !finished && i >= max_period);
+    #endif
     soup_count++;
 }
 
 
-clock_t start_clock;
-clock_t prev_clock;
+// these are from wall_time
+uint64_t start_clock;
+uint64_t prev_clock;
+#if ADAPTIVE > 0
+uint64_t prev_save_clock;
+#endif
 uint64_t soups;
 uint64_t prev_soups;
 int64_t max_soups;
 
-void show_status_force(clock_t current) {
+void show_status_force(uint64_t current) {
     if (max_soups < 0) {
-        printf("%"PRIu64" soups completed (%.3f soups/second current, %.3f overall)\n", soups, (double)(soups - prev_soups) / ((double)(current - prev_clock) / CLOCKS_PER_SEC), (double)soups / ((double)(current - start_clock) / CLOCKS_PER_SEC));
+        printf("%"PRIu64" soups completed (%.3f soups/second current, %.3f overall)\n", soups, (double)(soups - prev_soups) / ((double)(current - prev_clock) / 1e9), (double)soups / ((double)(current - start_clock) / 1e9));
     } else {
-        printf("%"PRIu64" soups completed (%.3f%%, %.3f soups/second current, %.3f overall)\n", soups, (double)soups / (double)max_soups * 100, (double)(soups - prev_soups) / ((double)(current - prev_clock) / CLOCKS_PER_SEC), (double)soups / ((double)(current - start_clock) / CLOCKS_PER_SEC));
+        printf("%"PRIu64" soups completed (%.3f%%, %.3f soups/second current, %.3f overall)\n", soups, (double)soups / (double)max_soups * 100, (double)(soups - prev_soups) / ((double)(current - prev_clock) / 1e9), (double)soups / ((double)(current - start_clock) / 1e9));
     }
 }
 
 void show_status() {
-    clock_t current = clock();
-    if ((((double)current - (double)prev_clock) / (double)CLOCKS_PER_SEC) >= 10) {
+    #if MINIMIZETHREADS > 0 && !defined(BRUH)
+    if (minimize_pending > 0) {
+        finish_minimized(false);
+    }
+    #endif
+    #ifndef BRUH
+    if (status_requested) {
+        status_requested = 0;
+        if (profiling) {
+            show_profile();
+        }
+        show_soup_history();
+    }
+    #endif
+    uint64_t current = wall_time();
+    if (current - prev_clock >= (uint64_t)10 * 1000000000) {
         show_status_force(current);
         prev_clock = current;
         prev_soups = soups;
     }
+    #if ADAPTIVE > 0 && !defined(BRUH)
+    // the learned weights are saved every 10 minutes
+    if (use_random_soups && current - prev_save_clock >= (uint64_t)600 * 1000000000) {
+        write_state(0);
+        prev_save_clock = current;
+    }
+    #endif
 }
 
 void cleanup() {
-    show_status_force(clock());
+    show_status_force(wall_time());
+    #if MINIMIZETHREADS > 0 && !defined(BRUH)
+    if (minimize_pending > 0) {
+        printf("%d ships were still being minimized\n", (int)minimize_pending);
+    }
+    #endif
+    #if AUTOTUNE > 0
+    free_autotune();
+    #endif
+    #if ADAPTIVE > 0
+    if (use_random_soups) {
+        #ifndef BRUH
+        write_state(0);
+        #endif
+        free_adaptive();
+    }
+    #endif
+    #ifndef BRUH
+    if (profiling) {
+        show_profile();
+    }
+    #endif
     free(phase_cache);
     for (uint16 i = 0; i < ENGINEPHASES; i++) {
         free(engine_phases[i]);
     }
+    free_stamps();
     free(rles);
+    #ifndef BRUH
+    free(adaptive_line);
+    #endif
     free(global_engines);
+    for (uint16 i = 0; i < SOUPHISTORY; i++) {
+        free(soup_history[i].engines);
+    }
+}
+
+#ifndef BRUH
+
+/*
+classify mode
+reads RLEs from a file or stdin and prints the period, displacement, population and bounding box of each one
+the patterns are run on a pool of threads (each one has its own grid), and the results are printed in the same order as the patterns
+*/
+
+// number of patterns that can be waiting to be printed
+#define CLASSIFYQUEUE 4096
+
+typedef struct classify_job {
+    // the rle, up to the !
+    char* rle;
+    // the rule from the header, or NULL if there isn't one
+    char* rule;
+    bool done;
+    char result[256];
+} classify_job;
+
+classify_job classify_jobs[CLASSIFYQUEUE];
+uint64_t jobs_read = 0;
+uint64_t jobs_started = 0;
+uint64_t jobs_printed = 0;
+bool input_done = false;
+uint32 classify_gens = 16384;
+pthread_mutex_t classify_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t job_available = PTHREAD_COND_INITIALIZER;
+pthread_cond_t job_finished = PTHREAD_COND_INITIALIZER;
+
+// reads an rle into data with its top left corner at (x, y), or just measures it if place is false
+// returns false if it isn't valid
+bool parse_rle(char* rle, bool place, uint16 x, uint16 y, uint16* width, uint16* height, uint32* population) {
+    uint32 cx = 0;
+    uint32 cy = 0;
+    uint32 run = 0;
+    *width = 0;
+    *population = 0;
+    for (char* c = rle; *c != '\0' && *c != '!'; c++) {
+        if (*c >= '0' && *c <= '9') {
+            run = run * 10 + (*c - '0');
+            if (run > WIDTHVALUE) {
+                return false;
+            }
+            continue;
+        }
+        if (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n') {
+            continue;
+        }
+        if (run == 0) {
+            run = 1;
+        }
+        uint8_t state;
+        if (*c == '$') {
+            cy += run;
+            cx = 0;
+            run = 0;
+            continue;
+        } else if (*c == 'b' || *c == '.') {
+            state = 0;
+        } else if (*c == 'o') {
+            state = 1;
+        } else if (*c >= 'A' && *c < 'A' + STATES - 1) {
+            state = *c - 'A' + 1;
+        } else {
+            return false;
+        }
+        if (cx + run > WIDTHVALUE || cy >= HEIGHTVALUE) {
+            return false;
+        }
+        if (state != 0) {
+            for (uint32 i = 0; i < run; i++) {
+                if (place) {
+                    data[((uint32)(y + cy) << WIDTH) + x + cx + i] = state;
+                }
+                if (cx + i + 1 > *width) {
+                    *width = cx + i + 1;
+                }
+                *height = cy + 1;
+            }
+            *population += run;
+        }
+        cx += run;
+        run = 0;
+    }
+    return true;
+}
+
+void classify_pattern(classify_job* job, uint64_t number) {
+    char* out = job->result;
+    #define result(...) snprintf(out, sizeof(job->result), __VA_ARGS__)
+    if (job->rule != NULL && strcasecmp(job->rule, RULESTR) != 0) {
+        result("%"PRIu64": different rule (%s)", number, job->rule);
+        return;
+    }
+    uint16 width;
+    uint16 height = 0;
+    uint32 population;
+    if (!parse_rle(job->rle, false, 0, 0, &width, &height, &population)) {
+        result("%"PRIu64": invalid rle", number);
+        return;
+    }
+    if (population == 0) {
+        result("%"PRIu64": empty pattern", number);
+        return;
+    }
+    if (width + 8 > WIDTHVALUE || height + 8 > HEIGHTVALUE) {
+        result("%"PRIu64": too big, population %"PRIuFAST32", bounding box %"PRIuFAST16"x%"PRIuFAST16, number, population, width, height);
+        return;
+    }
+    clear();
+    uint16 y = (HEIGHTVALUE - height) / 2;
+    uint16 x = (WIDTHVALUE - width) / 2;
+    for (uint16 cy = y; cy < y + height; cy++) {
+        memset(data + ((uint32)cy << WIDTH) + x, 0, width);
+    }
+    parse_rle(job->rle, true, x, y, &width, &height, &population);
+    top = y;
+    bottom = y + height;
+    left = x;
+    right = x + width;
+    // the first row and column might be empty
+    while (top < bottom) {
+        uint32 i = (uint32)top << WIDTH;
+        uint16 cx;
+        for (cx = left; cx < right && !data[i + cx]; cx++);
+        if (cx < right) {
+            break;
+        }
+        top++;
+    }
+    while (left < right) {
+        uint16 cy;
+        for (cy = top; cy < bottom && !data[((uint32)cy << WIDTH) + left]; cy++);
+        if (cy < bottom) {
+            break;
+        }
+        left++;
+    }
+    #if STATES > 2
+    pack_data();
+    #endif
+    #define bounds population, width, height
+    #define BOUNDS ", population %"PRIuFAST32", bounding box %"PRIuFAST16"x%"PRIuFAST16
+    phase_number = 0;
+    cached_phases = 0;
+    uint32 match = UINT_FAST32_MAX;
+    uint32 gen;
+    for (gen = 0; ; gen++) {
+        if (gen % CHECKINTERVAL == 0) {
+            #if STATES > 2
+            unpack_data();
+            #endif
+            cache_phase();
+            match = find_matching_phase();
+            if (match != UINT_FAST32_MAX) {
+                break;
+            }
+            phase_number++;
+        }
+        if (gen == classify_gens) {
+            result("%"PRIu64": unknown after %"PRIuFAST32" generations"BOUNDS, number, gen, bounds);
+            goto done;
+        }
+        if (top < 2 || bottom > HEIGHTVALUE - 2 || left < 2 || right > WIDTHVALUE - 2) {
+            result("%"PRIu64": hit the edge of the grid after %"PRIuFAST32" generations"BOUNDS, number, gen, bounds);
+            goto done;
+        }
+        run_generation();
+        if (top >= bottom) {
+            result("%"PRIu64": died at generation %"PRIuFAST32 BOUNDS, number, gen + 1, bounds);
+            goto done;
+        }
+    }
+    // the real period is a factor of the one that was found, so try those from the current phase
+    pattern_data* reference = phase_cache[phase_number];
+    uint32 found_period = (phase_number - match) * CHECKINTERVAL;
+    phase_number++;
+    for (uint32 period = 1; period <= found_period; period++) {
+        if (top < 2 || bottom > HEIGHTVALUE - 2 || left < 2 || right > WIDTHVALUE - 2) {
+            result("%"PRIu64": hit the edge of the grid after %"PRIuFAST32" generations"BOUNDS, number, gen + period, bounds);
+            goto done;
+        }
+        run_generation();
+        if (found_period % period != 0) {
+            continue;
+        }
+        #if STATES > 2
+        unpack_data();
+        #endif
+        cache_phase();
+        pattern_data* current = phase_cache[phase_number];
+        if (same_phase(current, reference)) {
+            int64_t dx = (int64_t)current->left - (int64_t)reference->left;
+            int64_t dy = (int64_t)current->top - (int64_t)reference->top;
+            if (dx == 0 && dy == 0) {
+                if (period == 1) {
+                    result("%"PRIu64": still life"BOUNDS, number, bounds);
+                } else {
+                    result("%"PRIu64": p%"PRIuFAST32" oscillator, period %"PRIuFAST32", displacement (0, 0)"BOUNDS, number, period, period, bounds);
+                }
+            } else {
+                char speed_str[32];
+                format_speed(speed_str, make_speed(dx, dy, period));
+                result("%"PRIu64": %s %s ship, period %"PRIuFAST32", displacement (%"PRId64", %"PRId64")"BOUNDS, number, speed_str, direction_names[get_direction(make_speed(dx, dy, period))], period, dx, dy, bounds);
+            }
+            goto done;
+        }
+        free(current);
+        cached_phases--;
+    }
+    result("%"PRIu64": unknown after %"PRIuFAST32" generations"BOUNDS, number, gen + found_period, bounds);
+    done:;
+    for (uint32 i = 0; i < cached_phases; i++) {
+        free(phase_cache[i]);
+    }
+    #undef result
+    #undef bounds
+    #undef BOUNDS
+}
+
+void* classify_worker(void* arg) {
+    soup_trace = 0;
+    phase_cache = malloc((classify_gens / CHECKINTERVAL + 2) * sizeof(pattern_data*));
+    pthread_mutex_lock(&classify_lock);
+    while (true) {
+        while (jobs_started == jobs_read && !input_done) {
+            pthread_cond_wait(&job_available, &classify_lock);
+        }
+        if (jobs_started == jobs_read) {
+            break;
+        }
+        uint64_t number = jobs_started++;
+        classify_job* job = &classify_jobs[number % CLASSIFYQUEUE];
+        pthread_mutex_unlock(&classify_lock);
+        classify_pattern(job, number + 1);
+        pthread_mutex_lock(&classify_lock);
+        job->done = true;
+        pthread_cond_broadcast(&job_finished);
+    }
+    pthread_mutex_unlock(&classify_lock);
+    free(phase_cache);
+    return NULL;
+}
+
+// prints the results that are done in order, if wait is true it waits for the next one, classify_lock should be held
+void print_results(bool wait) {
+    while (jobs_printed < jobs_read) {
+        classify_job* job = &classify_jobs[jobs_printed % CLASSIFYQUEUE];
+        if (!job->done) {
+            if (!wait) {
+                return;
+            }
+            pthread_cond_wait(&job_finished, &classify_lock);
+            continue;
+        }
+        printf("%s\n", job->result);
+        free(job->rle);
+        free(job->rule);
+        jobs_printed++;
+        wait = false;
+    }
+}
+
+void add_job(char* rle, char* rule) {
+    pthread_mutex_lock(&classify_lock);
+    while (jobs_read - jobs_printed >= CLASSIFYQUEUE) {
+        print_results(true);
+    }
+    classify_job* job = &classify_jobs[jobs_read % CLASSIFYQUEUE];
+    job->rle = rle;
+    job->rule = rule;
+    job->done = false;
+    jobs_read++;
+    pthread_cond_signal(&job_available);
+    print_results(false);
+    pthread_mutex_unlock(&classify_lock);
+}
+
+int classify(int argc, char** argv) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while ((opt = getopt(argc, argv, "t:g:")) != -1) {
+        switch (opt) {
+            case 't':
+                threads = atol(optarg);
+                break;
+            case 'g':
+                classify_gens = atol(optarg);
+                break;
+            default:
+                goto usage;
+        }
+    }
+    if (argc - optind > 1 || threads < 1) {
+        usage:
+        printf("Usage: nrss classify [-t threads] [-g max-generations] [file]\n");
+        return 1;
+    }
+    FILE* f = stdin;
+    if (argc - optind == 1 && strcmp(argv[optind], "-") != 0) {
+        f = fopen(argv[optind], "r");
+        if (f == 0) {
+            perror("Error opening file");
+            return 1;
+        }
+    }
+    init_kernels(-1);
+    #if STATES > 2
+    init_bdd();
+    #endif
+    pthread_t* workers = malloc(threads * sizeof(pthread_t));
+    for (long i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, classify_worker, NULL);
+    }
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+    char* rle = NULL;
+    size_t rle_length = 0;
+    char* rule = NULL;
+    while ((length = getline(&line, &line_size, f)) != -1) {
+        if (rle == NULL) {
+            char* c = line;
+            while (*c == ' ' || *c == '\t') {
+                c++;
+            }
+            if (*c == '#' || *c == '\n' || *c == '\r' || *c == '\0') {
+                continue;
+            }
+            if (*c == 'x' && strchr(c, '=') != NULL) {
+                free(rule);
+                rule = NULL;
+                char* rule_start = strstr(c, "rule");
+                if (rule_start != NULL && (rule_start = strchr(rule_start, '=')) != NULL) {
+                    rule_start++;
+                    while (*rule_start == ' ' || *rule_start == '\t') {
+                        rule_start++;
+                    }
+                    size_t rule_length = strcspn(rule_start, " \t\r\n,");
+                    rule = malloc(rule_length + 1);
+                    memcpy(rule, rule_start, rule_length);
+                    rule[rule_length] = '\0';
+                }
+                continue;
+            }
+        }
+        rle = realloc(rle, rle_length + length + 1);
+        memcpy(rle + rle_length, line, length + 1);
+        rle_length += length;
+        if (strchr(line, '!') != NULL) {
+            add_job(rle, rule);
+            rle = NULL;
+            rle_length = 0;
+            rule = NULL;
+        }
+    }
+    if (rle != NULL) {
+        add_job(rle, rule);
+    } else {
+        free(rule);
+    }
+    free(line);
+    if (f != stdin) {
+        fclose(f);
+    }
+    pthread_mutex_lock(&classify_lock);
+    input_done = true;
+    pthread_cond_broadcast(&job_available);
+    print_results(true);
+    while (jobs_printed < jobs_read) {
+        print_results(true);
+    }
+    pthread_mutex_unlock(&classify_lock);
+    for (long i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    return 0;
 }
 
+#endif
+
+
+// set by SIGINT, the search stops after the current soup (the state file can't be written from the signal handler)
+volatile sig_atomic_t stop_requested = 0;
+
 void on_sigint(int something) {
-    printf("\n");
-    cleanup();
-    exit(1);
+    stop_requested = 1;
+    // a second one stops right away
+    signal(SIGINT, SIG_DFL);
+}
+
+void on_crash(int sig) {
+    printf("\nCrashed (signal %d)\n", sig);
+    show_soup_history();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// reads engines from -r (phase,x,y:phase,x,y:...), returns the number of engines or 0 if it's invalid
+uint16 parse_replay(char* str) {
+    uint16 count = 1;
+    for (char* c = str; *c; c++) {
+        if (*c == ':') {
+            count++;
+        }
+    }
+    global_engines = malloc(sizeof(engine_info) * count);
+    char* end = str;
+    for (uint16 i = 0; i < count; i++) {
+        uint16 values[3];
+        for (uint16 j = 0; j < 3; j++) {
+            char* start = end;
+            values[j] = strtoul(start, &end, 10);
+            if (end == start || *end != (j < 2 ? ',' : (i + 1 < count ? ':' : '\0'))) {
+                return 0;
+            }
+            end++;
+        }
+        if (values[0] >= ENGINEPHASES) {
+            return 0;
+        }
+        global_engines[i].phase = values[0];
+        global_engines[i].x = values[1];
+        global_engines[i].y = values[2];
+    }
+    return count;
 }
 
 int main(int argc, char** argv) {
     #ifndef BRUH
-    if (argc != 6) {
-        printf("Usage: nrss <engine-count> <max-x-seperation> <max-period> <randomize-soups-1-or-0> <state-file>\n");
+    if (argc >= 2 && strcmp(argv[1], "classify") == 0) {
+        return classify(argc - 1, argv + 1);
+    }
+    int opt;
+    int32_t forced_kernel = -1;
+    char* replay = NULL;
+    while ((opt = getopt(argc, argv, "pk:d:s:r:")) != -1) {
+        switch (opt) {
+            case 'p':
+                init_profiling();
+                break;
+            case 'k':
+                for (uint16 i = 0; i < KERNEL_TYPES; i++) {
+                    if (strcmp(optarg, kernel_names[i]) == 0) {
+                        forced_kernel = i;
+                    }
+                }
+                if (forced_kernel < 0) {
+                    goto usage;
+                }
+                break;
+            case 'd':
+                trace_level = atoi(optarg);
+                tracing = trace_level > 0;
+                break;
+            case 's':
+                trace_every = atoll(optarg);
+                if (trace_every == 0) {
+                    goto usage;
+                }
+                break;
+            case 'r':
+                replay = optarg;
+                break;
+            default:
+                goto usage;
+        }
+    }
+    argv += optind - 1;
+    if (argc - optind != 5) {
+        usage:
+        printf("Usage: nrss [-p] [-k scalar|sse2|avx2|avx512] [-d trace-level] [-s trace-every] [-r engines] <engine-count> <max-x-seperation> <max-period> <randomize-soups-1-or-0> <state-file>\n");
         return 1;
     }
+    init_kernels(forced_kernel);
+    printf("Using %s kernels\n", kernel_names[kernel_type]);
     #else
     if (argc != 5) {
         printf("Usage: nrss <engine-count> <max-x-seperation> <max-period> <randomize-soups-1-or-0>\n");
         return 1;
     }
+    init_kernels(-1);
     #endif
     engines = atoi(argv[1]);
     max_x_sep = atoi(argv[2]);
@@ -946,25 +4265,93 @@ int main(int argc, char** argv) {
     use_random_soups = (bool)atoi(argv[4]);
     #ifndef BRUH
     state_file = argv[5];
+    // a replay isn't a random search, this has to be off before the state file is read so the adaptive line gets kept
+    if (replay != NULL) {
+        use_random_soups = false;
+    }
     #endif
+    #if AUTOTUNE > 0
+    phase_cache = malloc((max_period / AUTOTUNEMININTERVAL + 1) * sizeof(pattern_data*));
+    init_autotune();
+    #else
     phase_cache = malloc((max_period / CHECKINTERVAL + 1) * sizeof(pattern_data*));
+    #endif
+    #if STATES > 2
+    init_bdd();
+    #endif
     generate_phases();
+    #if ADAPTIVE > 0
+    if (use_random_soups) {
+        init_adaptive();
+    }
+    #endif
     read_state();
+    #ifndef BRUH
+    if (replay != NULL) {
+        engines = parse_replay(replay);
+        if (engines == 0) {
+            printf("Invalid engines for -r: %s\n", replay);
+            return 1;
+        }
+    } else {
+    #endif
     global_engines = malloc(sizeof(engine_info) * engines);
     for (uint16 i = 0; i < engines; i++) {
         global_engines[i].x = 0;
         global_engines[i].y = i == 0 ? 0 : MINY;
         global_engines[i].phase = 0;
     }
-    start_clock = clock();
+    #ifndef BRUH
+    }
+    #endif
+    // centre the biggest soup we can make, so ships going west or north have as much room as ships going east or south
+    uint32 soup_width = (uint32)max_x_sep + ENGINEWIDTH;
+    uint32 soup_height = (uint32)(engines - 1) * MAXY + ENGINEHEIGHT;
+    soup_x = soup_width < WIDTHVALUE - 4 ? (WIDTHVALUE - soup_width) / 2 : 2;
+    soup_y = soup_height < HEIGHTVALUE - 4 ? (HEIGHTVALUE - soup_height) / 2 : 2;
+    for (uint16 i = 0; i < SOUPHISTORY; i++) {
+        soup_history[i].engines = malloc(sizeof(engine_info) * engines);
+    }
+    start_clock = wall_time();
     prev_clock = start_clock;
+    #if ADAPTIVE > 0
+    prev_save_clock = start_clock;
+    #endif
     prev_soups = 0;
     signal(SIGINT, on_sigint);
+    signal(SIGSEGV, on_crash);
+    signal(SIGFPE, on_crash);
+    signal(SIGILL, on_crash);
+    signal(SIGABRT, on_crash);
+    #ifndef BRUH
+    signal(SIGBUS, on_crash);
+    signal(SIGUSR1, on_sigusr1);
+    signal(SIGUSR2, on_sigusr2);
+    #if MINIMIZETHREADS > 0
+    init_minimize();
+    #endif
+    #if BANDTHREADS > 1
+    init_bands();
+    #endif
+    if (replay != NULL) {
+        // the soup is traced no matter what -s is
+        tracing = true;
+        trace_every = 1;
+        printf("Replaying soup\n");
+        run_soup();
+        soups++;
+        #if MINIMIZETHREADS > 0
+        finish_minimized(true);
+        #endif
+        cleanup();
+        return 0;
+    }
+    #endif
     if (use_random_soups) {
         init_rng();
         max_soups = -1;
         printf("Starting search\n");
-        while (true) {
+        while (!stop_requested) {
             run_soup();
             soups++;
             show_status();
@@ -972,15 +4359,18 @@ int main(int argc, char** argv) {
     } else {
         max_soups = ENGINEPHASES;
         for (uint16 i = 0; i < engines - 1; i++) {
-            max_soups *= (int64_t)ENGINEPHASES * (int64_t)(MAXY - MINY) * ((int64_t)max_x_sep + 1);
+            max_soups *= (int64_t)ENGINEPHASES * (int64_t)(MAXY - MINY + 1) * ((int64_t)max_x_sep + 1);
         }
         printf("Searching %"PRIu64" soups\n", max_soups);
-        for (uint64_t i = 0; i < max_soups; i++) {
+        for (uint64_t i = 0; i < max_soups && !stop_requested; i++) {
             run_soup();
             soups++;
             show_status();
         }
     }
+    if (stop_requested) {
+        printf("\n");
+    }
     cleanup();
-    return 0;
+    return stop_requested ? 1 : 0;
 }